@@ -0,0 +1,167 @@
+#include "AssetIndex.hpp"
+
+#include <cstring>
+
+#ifdef _WIN32
+	#define WIN32_LEAN_AND_MEAN
+	#include <windows.h>
+#else
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+#ifdef DOXYGEN
+namespace mdrpc {
+#else
+namespace mdrpc LOCAL_SYM {
+#endif
+
+	bool AssetIndex::Open(const std::string& path) {
+		Close();
+
+#ifdef _WIN32
+		HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if(file == INVALID_HANDLE_VALUE)
+			return false;
+
+		LARGE_INTEGER file_size;
+		if(!GetFileSizeEx(file, &file_size) || file_size.QuadPart < static_cast<LONGLONG>(sizeof(AssetIndexFormat::Header))) {
+			CloseHandle(file);
+			return false;
+		}
+
+		HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		CloseHandle(file);
+		if(!mapping)
+			return false;
+
+		auto view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		if(!view) {
+			CloseHandle(mapping);
+			return false;
+		}
+
+		file_mapping = mapping;
+		data = static_cast<const char*>(view);
+		size = static_cast<std::size_t>(file_size.QuadPart);
+#else
+		int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if(fd < 0)
+			return false;
+
+		struct stat st;
+		if(fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(AssetIndexFormat::Header))) {
+			close(fd);
+			return false;
+		}
+
+		auto view = mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+		close(fd);
+		if(view == MAP_FAILED)
+			return false;
+
+		data = static_cast<const char*>(view);
+		size = static_cast<std::size_t>(st.st_size);
+#endif
+
+		header = reinterpret_cast<const AssetIndexFormat::Header*>(data);
+
+		auto table_size = static_cast<std::uint64_t>(header->slot_count) * sizeof(AssetIndexFormat::Slot);
+
+		bool valid = memcmp(header->magic, AssetIndexFormat::magic, sizeof(header->magic)) == 0
+			&& header->version == AssetIndexFormat::version
+			&& header->slot_count != 0
+			&& (header->slot_count & (header->slot_count - 1)) == 0
+			&& sizeof(AssetIndexFormat::Header) + table_size + header->strings_size <= size;
+
+		if(!valid) {
+			Close();
+			return false;
+		}
+
+		slots = reinterpret_cast<const AssetIndexFormat::Slot*>(data + sizeof(AssetIndexFormat::Header));
+		strings = data + sizeof(AssetIndexFormat::Header) + table_size;
+		return true;
+	}
+
+	void AssetIndex::Close() {
+		if(!data)
+			return;
+
+#ifdef _WIN32
+		UnmapViewOfFile(data);
+		CloseHandle(file_mapping);
+		file_mapping = nullptr;
+#else
+		munmap(const_cast<char*>(data), size);
+#endif
+
+		data = nullptr;
+		size = 0;
+		header = nullptr;
+		slots = nullptr;
+		strings = nullptr;
+	}
+
+	std::string AssetIndex::Find(const std::string& artist, const std::string& album) const {
+		if(!data || artist.empty())
+			return std::string();
+
+		if(!album.empty()) {
+			auto key = FindKey(artist, album);
+			if(!key.empty())
+				return key;
+		}
+
+		return FindKey(artist, std::string());
+	}
+
+	std::string AssetIndex::FindKey(const std::string& artist, const std::string& album) const {
+		auto hash = AssetIndexFormat::Hash(artist, album);
+		auto tag = static_cast<std::uint32_t>(hash >> 32);
+		auto mask = header->slot_count - 1;
+		auto key_length = artist.size() + 1 + album.size();
+
+		// Compares a stored (already folded) key against the one we are looking for.
+		auto matches = [&](const char* stored) {
+			std::size_t i = 0;
+
+			for(char c : artist)
+				if(stored[i++] != AssetIndexFormat::Fold(c))
+					return false;
+
+			if(stored[i++] != AssetIndexFormat::key_separator)
+				return false;
+
+			for(char c : album)
+				if(stored[i++] != AssetIndexFormat::Fold(c))
+					return false;
+
+			return true;
+		};
+
+		// The table is never full, so there always is an empty slot to stop at;
+		// the probe limit only guards against a corrupt file.
+		for(std::uint32_t probe = 0, i = static_cast<std::uint32_t>(hash) & mask; probe <= mask; ++probe, i = (i + 1) & mask) {
+			auto& slot = slots[i];
+
+			if(slot.key_length == 0)
+				break;
+
+			if(slot.tag != tag || slot.key_length != key_length)
+				continue;
+
+			if(static_cast<std::uint64_t>(slot.key_offset) + slot.key_length > header->strings_size
+				|| static_cast<std::uint64_t>(slot.value_offset) + slot.value_length > header->strings_size)
+				break;
+
+			if(matches(strings + slot.key_offset))
+				return std::string(strings + slot.value_offset, slot.value_length);
+		}
+
+		return std::string();
+	}
+
+}
@@ -0,0 +1,192 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "SymHide.hpp"
+
+#ifdef DOXYGEN
+namespace mdrpc {
+#else
+namespace mdrpc LOCAL_SYM {
+#endif
+
+/**
+ * Artist/album to Discord asset key index.
+ *
+ * The index file is built offline (see tools/asset-index) and memory mapped as is,
+ * so opening it costs nothing and lookups only touch the pages they need,
+ * no matter how many entries it has.
+ *
+ * The file is a header, an open addressing hash table (linear probing, at most 70% full)
+ * and the key/value strings. Keys are the lowercased artist and album joined by
+ * key_separator; artist-wide entries have an empty album. Everything is in the byte order
+ * of the machine that built it, and the magic doubles as a byte order check.
+ */
+namespace AssetIndexFormat {
+
+	/**
+	 * Index file magic.
+	 */
+	constexpr static char magic[4] = { 'M', 'D', 'A', 'I' };
+
+	/**
+	 * Index format version.
+	 */
+	constexpr static std::uint32_t version = 1;
+
+	/**
+	 * Separates the artist and album in a key.
+	 */
+	constexpr static char key_separator = '\x1f';
+
+	/**
+	 * Longest key or value that fits in a slot.
+	 */
+	constexpr static std::size_t max_string_length = 0xFFFF;
+
+	struct Header {
+		char magic[4];
+		std::uint32_t version;
+
+		/**
+		 * Number of slots in the hash table, a power of two.
+		 */
+		std::uint32_t slot_count;
+
+		/**
+		 * Number of used slots.
+		 */
+		std::uint32_t entry_count;
+
+		/**
+		 * Size of the string area that follows the table.
+		 */
+		std::uint64_t strings_size;
+	};
+
+	/**
+	 * Hash table slot. Empty slots have a key_length of 0.
+	 */
+	struct Slot {
+		/**
+		 * Upper half of the key's hash, to skip most key comparisons.
+		 */
+		std::uint32_t tag;
+
+		/**
+		 * Offsets into the string area.
+		 */
+		std::uint32_t key_offset;
+		std::uint32_t value_offset;
+
+		std::uint16_t key_length;
+		std::uint16_t value_length;
+	};
+
+	static_assert(sizeof(Header) == 24, "index header layout changed");
+	static_assert(sizeof(Slot) == 16, "index slot layout changed");
+
+	/**
+	 * Lowercases ASCII letters; everything else (including UTF-8) is left alone.
+	 */
+	inline char Fold(char c) {
+		return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+	}
+
+	/**
+	 * 64-bit FNV-1a of the folded key for an artist and album.
+	 */
+	inline std::uint64_t Hash(const std::string& artist, const std::string& album) {
+		std::uint64_t hash = 14695981039346656037ull;
+
+		auto add = [&](char c) {
+			hash ^= static_cast<unsigned char>(Fold(c));
+			hash *= 1099511628211ull;
+		};
+
+		for(char c : artist)
+			add(c);
+
+		add(key_separator);
+
+		for(char c : album)
+			add(c);
+
+		return hash;
+	}
+
+}
+
+	/**
+	 * A memory mapped asset index, for looking up the Discord asset key
+	 * to show for an artist or album.
+	 */
+	struct AssetIndex {
+
+		AssetIndex() = default;
+		AssetIndex(const AssetIndex&) = delete;
+		AssetIndex& operator=(const AssetIndex&) = delete;
+
+		~AssetIndex() {
+			Close();
+		}
+
+		/**
+		 * Maps an index file. Only the header is looked at.
+		 *
+		 * \param[in] path Path of the index file
+		 * \return false if the file could not be mapped or is not a (compatible) index
+		 */
+		bool Open(const std::string& path);
+
+		/**
+		 * Unmaps the index file, if one is open.
+		 */
+		void Close();
+
+		/**
+		 * Returns true if an index is open.
+		 */
+		bool IsOpen() const {
+			return data != nullptr;
+		}
+
+		/**
+		 * Looks up the asset key for an album, falling back to the artist's.
+		 *
+		 * \param[in] artist Artist, as in the metadata
+		 * \param[in] album Album, as in the metadata (may be empty)
+		 * \return The asset key, or an empty string if there is none.
+		 */
+		std::string Find(const std::string& artist, const std::string& album) const;
+
+	private:
+
+		/**
+		 * Looks up a single key.
+		 *
+		 * \return The value, or an empty string if there is none.
+		 */
+		std::string FindKey(const std::string& artist, const std::string& album) const;
+
+		/**
+		 * The mapped file.
+		 */
+		const char* data = nullptr;
+		std::size_t size = 0;
+
+		/**
+		 * Parts of the mapped file.
+		 */
+		const AssetIndexFormat::Header* header = nullptr;
+		const AssetIndexFormat::Slot* slots = nullptr;
+		const char* strings = nullptr;
+
+#ifdef _WIN32
+		void* file_mapping = nullptr;
+#endif
+	};
+
+}
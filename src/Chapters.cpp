@@ -0,0 +1,100 @@
+#include "Chapters.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef DOXYGEN
+namespace mdrpc {
+#else
+namespace mdrpc LOCAL_SYM {
+#endif
+
+	std::shared_ptr<const ChapterIndex> ChapterIndex::Load(ModernMPV::SafeHandle& handle) {
+		struct Entry {
+			double start;
+			const char* title;
+		};
+
+		std::shared_ptr<ChapterIndex> index;
+
+		ModernMPV::Properties::get_node_array_raw(handle, "chapter-list", [&](mpv_node node) {
+			auto list = node.u.list;
+
+			if(list->num < 2)
+				return;
+
+			std::vector<Entry> entries;
+			entries.reserve(list->num);
+
+			std::size_t title_bytes = 0;
+
+			for(int i = 0; i < list->num; ++i) {
+				auto& chapter = list->values[i];
+
+				if(chapter.format != MPV_FORMAT_NODE_MAP)
+					continue;
+
+				Entry entry { -1.0, nullptr };
+
+				for(int j = 0; j < chapter.u.list->num; ++j) {
+					auto& value = chapter.u.list->values[j];
+
+					if(!strcmp(chapter.u.list->keys[j], "time") && value.format == MPV_FORMAT_DOUBLE)
+						entry.start = value.u.double_;
+					else if(!strcmp(chapter.u.list->keys[j], "title") && value.format == MPV_FORMAT_STRING)
+						entry.title = value.u.string;
+				}
+
+				if(entry.start < 0.0)
+					continue;
+
+				if(entry.title)
+					title_bytes += strlen(entry.title);
+
+				entries.push_back(entry);
+			}
+
+			if(entries.size() < 2)
+				return;
+
+			// mpv hands them out sorted already, but nothing guarantees it
+			std::stable_sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+				return a.start < b.start;
+			});
+
+			index = std::make_shared<ChapterIndex>();
+			index->starts.reserve(entries.size());
+			index->title_offsets.reserve(entries.size());
+			index->titles.reserve(title_bytes);
+
+			for(auto& entry : entries) {
+				index->starts.push_back(entry.start);
+				index->title_offsets.push_back(static_cast<std::uint32_t>(index->titles.size()));
+
+				if(entry.title)
+					index->titles.append(entry.title);
+			}
+		});
+
+		return index;
+	}
+
+	int ChapterIndex::Find(double position) const {
+		auto it = std::upper_bound(starts.begin(), starts.end(), position);
+		return static_cast<int>(it - starts.begin()) - 1;
+	}
+
+	std::string ChapterIndex::Title(int chapter) const {
+		if(chapter < 0 || static_cast<std::size_t>(chapter) >= starts.size())
+			return std::string();
+
+		auto begin = title_offsets[chapter];
+		auto end = static_cast<std::size_t>(chapter) + 1 < title_offsets.size() ? title_offsets[chapter + 1] : titles.size();
+
+		if(begin == end)
+			return "Chapter " + std::to_string(chapter + 1);
+
+		return titles.substr(begin, end - begin);
+	}
+
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "SymHide.hpp"
+#include "ModernMPV.hpp"
+
+#ifdef DOXYGEN
+namespace mdrpc {
+#else
+namespace mdrpc LOCAL_SYM {
+#endif
+
+	/**
+	 * The chapters of a file, loaded once from `chapter-list` and kept sorted by start time,
+	 * so the current chapter can be found by binary search on the playback position.
+	 *
+	 * Start times and titles are kept in flat arrays (titles share one string),
+	 * so files with thousands of chapters stay cheap to load and search.
+	 * Never modified after Load(), so it can be shared between threads.
+	 */
+	struct ChapterIndex {
+
+		/**
+		 * Loads the chapters of the current file.
+		 *
+		 * \param[in] handle Safe handle to use
+		 * \return The index, or nullptr if the file has fewer than two chapters.
+		 */
+		static std::shared_ptr<const ChapterIndex> Load(ModernMPV::SafeHandle& handle);
+
+		/**
+		 * Returns the chapter playing at the given position, or -1 if it is before the first chapter.
+		 *
+		 * \param[in] position Playback position, in seconds
+		 */
+		int Find(double position) const;
+
+		/**
+		 * Returns the title of a chapter, which is "Chapter <n>" if the file did not name it.
+		 *
+		 * \param[in] chapter Chapter, as returned by Find()
+		 */
+		std::string Title(int chapter) const;
+
+		/**
+		 * Returns the number of chapters.
+		 */
+		std::size_t Size() const {
+			return starts.size();
+		}
+
+	private:
+
+		/**
+		 * Start time of each chapter, in seconds, ascending.
+		 */
+		std::vector<double> starts;
+
+		/**
+		 * Offset of each chapter's title in titles; a title ends where the next one begins.
+		 */
+		std::vector<std::uint32_t> title_offsets;
+
+		/**
+		 * All titles, back to back.
+		 */
+		std::string titles;
+	};
+
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include "SymHide.hpp"
+
+//
+// define MDRPC_VIRTUAL_CLOCK to make every clock read come from Utils::Clock::SetVirtual()
+// instead of the system. Only used by the offline replay tool.
+//
+
+#ifdef DOXYGEN
+namespace Utils {
+#else
+namespace Utils LOCAL_SYM {
+#endif
+
+	/**
+	 * Clock used by mdrpc for anything timing related,
+	 * so that time can be virtualized for replaying event traces.
+	 */
+	struct Clock {
+
+		using time_point = std::chrono::steady_clock::time_point;
+
+		/**
+		 * Returns the current monotonic time.
+		 */
+		static time_point Now() {
+#ifdef MDRPC_VIRTUAL_CLOCK
+			return time_point(std::chrono::microseconds(virtual_us().load()));
+#else
+			return std::chrono::steady_clock::now();
+#endif
+		}
+
+		/**
+		 * Returns the current Unix time, in (fractional) seconds.
+		 */
+		static double UnixNow() {
+#ifdef MDRPC_VIRTUAL_CLOCK
+			return static_cast<double>(virtual_unix_base_us().load() + virtual_us().load()) / 1000000.0;
+#else
+			return std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+#endif
+		}
+
+#ifdef MDRPC_VIRTUAL_CLOCK
+		/**
+		 * Sets the virtual time.
+		 *
+		 * \param[in] us Monotonic time, in microseconds
+		 * \param[in] unix_base_us Unix time (in microseconds) that monotonic time 0 corresponds to
+		 */
+		static void SetVirtual(std::int64_t us, std::int64_t unix_base_us) {
+			virtual_us() = us;
+			virtual_unix_base_us() = unix_base_us;
+		}
+
+	private:
+		static std::atomic<std::int64_t>& virtual_us() {
+			static std::atomic<std::int64_t> us { 0 };
+			return us;
+		}
+
+		static std::atomic<std::int64_t>& virtual_unix_base_us() {
+			static std::atomic<std::int64_t> us { 0 };
+			return us;
+		}
+#endif
+	};
+
+}
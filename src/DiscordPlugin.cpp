@@ -1,6 +1,12 @@
 #include <sstream>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
 #include "SymHide.hpp"
 #include "DiscordPlugin.hpp"
+#include "Tracing.hpp"
+#include "Log.hpp"
 
 #ifdef DOXYGEN
 namespace mdrpc {
@@ -38,204 +44,810 @@ namespace mdrpc LOCAL_SYM {
 		"Buffering Remote Content"
 	}};
 
+	/**
+	 * Metadata keys to resolve the artist from, in increasing priority.
+	 */
+	constexpr std::array<const char*, 2> artist_keys = {{
+		"artist",
+		"ARTIST"
+	}};
+
+	/**
+	 * Metadata keys to resolve the title from, in increasing priority.
+	 * `icy-title` changes mid-stream on internet radio.
+	 */
+	constexpr std::array<const char*, 3> title_keys = {{
+		"title",
+		"TITLE",
+		"icy-title"
+	}};
+
+	/**
+	 * Metadata keys to resolve the album from, in increasing priority.
+	 */
+	constexpr std::array<const char*, 2> album_keys = {{
+		"album",
+		"ALBUM"
+	}};
+
+	/**
+	 * Resolves a single field from a metadata map node.
+	 * Later keys win over earlier ones, and empty values are skipped.
+	 */
+	template<std::size_t N>
+	static std::string ResolveMetadataField(const mpv_node& node, const std::array<const char*, N>& keys) {
+		const char* value = nullptr;
+
+		for(const char* key : keys) {
+			auto found = ModernMPV::Properties::find_node_map_string(node, key);
+
+			if(!found || found[0] == '\0')
+				continue;
+
+			value = found;
+		}
+
+		return value ? std::string(value) : std::string();
+	}
+
+	/**
+	 * Copies a string into a fixed size buffer, cutting it at a UTF-8 character boundary if it does not fit.
+	 */
+	template<std::size_t N>
+	static void CopyField(char (&dest)[N], const std::string& src) {
+		auto length = std::min(src.size(), N - 1);
+
+		// don't leave half a character behind
+		while(length > 0 && length < src.size() && (static_cast<unsigned char>(src[length]) & 0xC0) == 0x80)
+			--length;
+
+		memcpy(dest, src.data(), length);
+		dest[length] = '\0';
+	}
+
+	/**
+	 * Returns everything up to the last path separator of a path or URL (empty if there is none).
+	 */
+	static std::string DirectoryOf(const std::string& path) {
+		auto separator = path.find_last_of("/\\");
+		return separator == std::string::npos ? std::string() : path.substr(0, separator);
+	}
+
+	/**
+	 * Returns everything after the last path separator of a path or URL, like mpv's `filename` property.
+	 */
+	static std::string FileNameOf(const std::string& path) {
+		auto separator = path.find_last_of("/\\");
+		return separator == std::string::npos ? path : path.substr(separator + 1);
+	}
+
+	/**
+	 * Guesses a track title from a file name such as `03 - Title.flac` or `03. Title.flac`.
+	 */
+	static std::string TitleFromFileName(const std::string& name) {
+		auto dot = name.find_last_of('.');
+		auto stem = dot == std::string::npos || dot == 0 ? name : name.substr(0, dot);
+
+		std::size_t start = 0;
+		while(start < stem.size() && stem[start] >= '0' && stem[start] <= '9')
+			++start;
+
+		if(start == 0)
+			return stem;
+
+		while(start < stem.size() && (stem[start] == ' ' || stem[start] == '.' || stem[start] == '-' || stem[start] == '_'))
+			++start;
+
+		// keep titles that are nothing but a number
+		return start < stem.size() ? stem.substr(start) : stem;
+	}
+
+	/**
+	 * Returns true if two snapshots render to the same presence, timeline aside.
+	 */
+	static bool RendersSame(const PresenceSnapshot& a, const PresenceSnapshot& b) {
+		return a.predicted_entry == b.predicted_entry
+			&& a.state == b.state
+			&& a.speed == b.speed
+			&& !strcmp(a.artist, b.artist)
+			&& !strcmp(a.title, b.title)
+			&& !strcmp(a.album, b.album)
+			&& !strcmp(a.filename, b.filename)
+			&& !strcmp(a.large_image, b.large_image);
+	}
+
 	DiscordPlugin::DiscordPlugin(mpv_handle* handle) {
 		mpvHandle = ModernMPV::SafeHandle(handle);
+
+		// so --msg-level=<script name>=<level> works as it does for every other script
+		msg_levels = ModernMPV::Properties::get_string_map(mpvHandle, "msg-level");
+		Log::SetLevel(Log::LevelFromMpv(msg_levels, mpv_client_name(mpvHandle)));
+		Log::SetWakeup(&DiscordPlugin::WakeEventLoop, this);
+
+		options.Load(mpvHandle);
+
+		if(!options.asset_index_path.empty() && !asset_index.Open(options.asset_index_path))
+			MDRPC_LOG_ERROR("could not open asset index \"%s\"", options.asset_index_path.c_str());
+
+		if(!options.history_path.empty()) {
+			if(history.Open(options.history_path, static_cast<std::uint64_t>(options.history_rotate_kb) * 1024))
+				mpv_observe_property(mpvHandle, ObservedProperty::Path, "path", MPV_FORMAT_STRING);
+			else
+				MDRPC_LOG_ERROR("could not open listening history \"%s\"", options.history_path.c_str());
+		}
+
+		mpv_observe_property(mpvHandle, ObservedProperty::Metadata, "metadata", MPV_FORMAT_NODE);
+		mpv_observe_property(mpvHandle, ObservedProperty::Pause, "pause", MPV_FORMAT_FLAG);
+		mpv_observe_property(mpvHandle, ObservedProperty::PausedForCache, "paused-for-cache", MPV_FORMAT_FLAG);
+		mpv_observe_property(mpvHandle, ObservedProperty::Speed, "speed", MPV_FORMAT_DOUBLE);
+		mpv_observe_property(mpvHandle, ObservedProperty::Duration, "duration", MPV_FORMAT_DOUBLE);
 	}
 
 	DiscordPlugin::~DiscordPlugin() {
-		if(!cached_metadata.empty())
-			cached_metadata.clear();
 	}
 
 
 	void DiscordPlugin::ProcessEvent(mpv_event* ev) {
 		if(!ev)
 			return;
+
+		MDRPC_TRACE_SPAN("DiscordPlugin::ProcessEvent");
 			
 		switch(ev->event_id) {
 			default:
 				break;
 
+			case MPV_EVENT_START_FILE: {
+				auto start_file = static_cast<mpv_event_start_file*>(ev->data);
+
+				if(next_entry != 0 && start_file && start_file->playlist_entry_id == next_entry)
+					SwitchToNext();
+
+				next_entry = 0;
+			} break;
+
 			case MPV_EVENT_FILE_LOADED: {
-				current_state = PlayerState::Playing;
-				cached_metadata.clear();
+				idle = false;
+				load_pending = true;
+				predicted_entry = 0;
 
-				// load in metadata
-				cached_metadata = ModernMPV::Properties::get_node_map(mpvHandle, "metadata");
-				cached_filename = ModernMPV::Properties::get_osd_string(mpvHandle, "filename");
+				if(first_load == Utils::Clock::time_point())
+					first_load = Utils::Clock::Now();
 
-				if(discord_runner.Running())
-					discord_runner.Stop();
+				BeginPlay();
+				Debounce();
+			} break;
 
-				if(state_runner.Running())
-					state_runner.Stop();
+			case MPV_EVENT_END_FILE: {
+				auto end_file = static_cast<mpv_event_end_file*>(ev->data);
+				predicted_entry = 0;
+				EndPlay(end_file ? static_cast<std::int32_t>(end_file->reason) : 0);
+			} break;
 
-				discord_runner.Start(1500, [&]() {
-					RpcThreadInterval();
-				}, [&]() {
-					// Initalize discord
-					RpcThreadInit();
-				});
+			case MPV_EVENT_PROPERTY_CHANGE: {
+				auto prop = static_cast<mpv_event_property*>(ev->data);
 
-				state_runner.Start(500, [&]() {
-					StateThreadInterval();
-				});
+				switch(ev->reply_userdata) {
+					case ObservedProperty::Metadata:
+						MetadataChanged(prop->format == MPV_FORMAT_NODE ? static_cast<mpv_node*>(prop->data) : nullptr);
+						break;
+
+					case ObservedProperty::Path:
+						// goes away when the file ends; the play keeps the path it had
+						if(prop->format == MPV_FORMAT_STRING && *static_cast<char**>(prop->data))
+							current_play.path = *static_cast<char**>(prop->data);
+						break;
+
+					default:
+						PlaybackChanged(ev->reply_userdata, prop);
+						break;
+				}
+			} break;
+
+			case MPV_EVENT_SEEK:
+			case MPV_EVENT_PLAYBACK_RESTART: {
+				Debounce();
 			} break;
 				
 			case MPV_EVENT_IDLE: {
-				if(state_runner.Running())
-					state_runner.Stop();
-
-				current_state = PlayerState::Idle;
+				idle = true;
+				std::atomic_store(&chapters, std::shared_ptr<const ChapterIndex>());
+				PublishSnapshot();
 			} break;
 
 			case MPV_EVENT_SHUTDOWN: {
+				settle_pending = false;
+
+				// write out whatever history is still queued
+				EndPlay(MPV_END_FILE_REASON_QUIT);
+				history.Close();
+
 				if(discord_runner.Running())
 					discord_runner.Stop();
 
-				if(state_runner.Running())
-					state_runner.Stop();
-
+				Discord_SetEventNotify(nullptr, nullptr);
 				Discord_Shutdown();
+
+				// nothing else logs from other threads now; what is left is flushed by the caller
+				Log::SetWakeup(nullptr, nullptr);
 			}
 		}
 	}
 
+	void DiscordPlugin::MetadataChanged(const mpv_node* node) {
+		// the previous file's metadata going away; the next file's is not in yet
+		if(!node && predicted_entry != 0)
+			return;
+
+		SongInfo info;
+
+		if(node && node->format == MPV_FORMAT_NODE_MAP) {
+			info.artist = ResolveMetadataField(*node, artist_keys);
+			info.title = ResolveMetadataField(*node, title_keys);
+			info.album = ResolveMetadataField(*node, album_keys);
+		}
+
+		if(info == song_info)
+			return;
+
+		bool album_changed = info.artist != song_info.artist || info.album != song_info.album;
+
+		// Only look up art when the album actually changed, i.e. about once per file
+		// (icy-title changes on radio streams leave it alone).
+		if(asset_index.IsOpen() && album_changed) {
+			MDRPC_TRACE_SPAN("asset index lookup");
+			large_image = asset_index.Find(info.artist, info.album);
+		}
+
+		song_info = info;
+		PublishSnapshot();
+
+		// the next entry's prediction borrows this file's artist and album
+		if(album_changed && next_entry != 0)
+			PrepareNext();
+	}
+
+	void DiscordPlugin::PlaybackChanged(std::uint64_t id, const mpv_event_property* prop) {
+		auto flag = [&]() {
+			return prop->format == MPV_FORMAT_FLAG && *static_cast<int*>(prop->data) != 0;
+		};
+
+		auto number = [&](double fallback) {
+			return prop->format == MPV_FORMAT_DOUBLE ? *static_cast<double*>(prop->data) : fallback;
+		};
+
+		switch(id) {
+			case ObservedProperty::Pause:
+				paused = flag();
+				TrackPause();
+				break;
+
+			case ObservedProperty::PausedForCache:
+				buffering = flag();
+				break;
+
+			case ObservedProperty::Speed:
+				speed = number(1.0);
+				break;
+
+			case ObservedProperty::Duration:
+				duration = number(-1.0);
+				break;
+
+			default:
+				return;
+		}
+
+		// Playback stopped, resumed or changed pace; the position no longer follows the old anchor.
+		if(id != ObservedProperty::Duration)
+			anchor_stale = true;
+
+		PublishSnapshot();
+	}
+
+	/**
+	 * Converts Unix time in (fractional) seconds to microseconds.
+	 */
+	static std::int64_t UnixMicroseconds(double unix_time) {
+		return static_cast<std::int64_t>(std::llround(unix_time * 1000000.0));
+	}
+
+	void DiscordPlugin::BeginPlay() {
+		if(!history.IsOpen())
+			return;
+
+		// the path may already be there, observed before the file finished loading
+		current_play.start_us = UnixMicroseconds(Utils::Clock::UnixNow());
+		current_play.paused_us = 0;
+		play_active = true;
+		pause_started_unix = 0.0;
+		TrackPause();
+	}
+
+	void DiscordPlugin::EndPlay(std::int32_t reason) {
+		if(!play_active)
+			return;
+
+		auto now = Utils::Clock::UnixNow();
+
+		if(pause_started_unix != 0.0)
+			current_play.paused_us += UnixMicroseconds(now - pause_started_unix);
+
+		current_play.stop_us = UnixMicroseconds(now);
+		current_play.end_reason = reason;
+		current_play.artist = song_info.artist;
+		current_play.title = song_info.title;
+		current_play.album = song_info.album;
+
+		// only queued here, the writer thread does the disk I/O
+		history.Submit(std::move(current_play));
+
+		current_play = History::Play();
+		play_active = false;
+		pause_started_unix = 0.0;
+	}
+
+	void DiscordPlugin::TrackPause() {
+		if(!play_active)
+			return;
+
+		auto now = Utils::Clock::UnixNow();
+
+		if(paused && pause_started_unix == 0.0) {
+			pause_started_unix = now;
+		} else if(!paused && pause_started_unix != 0.0) {
+			current_play.paused_us += UnixMicroseconds(now - pause_started_unix);
+			pause_started_unix = 0.0;
+		}
+	}
+
+	void DiscordPlugin::PublishSnapshot() {
+		if(!settled && predicted_entry == 0)
+			return;
+
+		MDRPC_TRACE_SPAN("DiscordPlugin::PublishSnapshot");
+		PresenceSnapshot snapshot;
+
+		snapshot.state = GetPlayerState();
+		snapshot.speed = speed;
+
+		if(snapshot.state != PlayerState::Idle)
+			Anchor();
+
+		snapshot.timeline = GetTimeline(snapshot.state);
+		snapshot.position = anchor_position;
+		snapshot.position_unix = anchor_unix;
+		CopyField(snapshot.artist, song_info.artist);
+		CopyField(snapshot.title, song_info.title);
+		CopyField(snapshot.album, song_info.album);
+		CopyField(snapshot.filename, cached_filename);
+		CopyField(snapshot.large_image, large_image);
+		snapshot.predicted_entry = predicted_entry;
+
+		presence_snapshot.Store(snapshot);
+
+		if(discord_runner.Running())
+			discord_runner.Wake();
+	}
+
+	void DiscordPlugin::PrepareNext() {
+		MDRPC_TRACE_SPAN("DiscordPlugin::PrepareNext");
+		next_entry = 0;
+
+		std::int64_t position = -1;
+		std::int64_t count = 0;
+
+		ModernMPV::Properties::get_int64(mpvHandle, "playlist-pos", [&](std::int64_t v) {
+			position = v;
+		});
+
+		ModernMPV::Properties::get_int64(mpvHandle, "playlist-count", [&](std::int64_t v) {
+			count = v;
+		});
+
+		if(position < 0 || position + 1 >= count)
+			return;
+
+		auto entry = "playlist/" + std::to_string(position + 1) + "/";
+		std::int64_t id = 0;
+
+		ModernMPV::Properties::get_int64(mpvHandle, entry + "id", [&](std::int64_t v) {
+			id = v;
+		});
+
+		auto path = ModernMPV::Properties::get_string(mpvHandle, entry + "filename");
+
+		if(id == 0 || path.empty())
+			return;
+
+		// only set by playlist files (#EXTINF) and the like
+		auto title = ModernMPV::Properties::get_string(mpvHandle, entry + "title");
+		auto current_path = ModernMPV::Properties::get_string(mpvHandle, "playlist/" + std::to_string(position) + "/filename");
+
+		// The next file of an album is usually right next to this one.
+		bool same_album = DirectoryOf(path) == DirectoryOf(current_path);
+
+		SongInfo info;
+
+		if(same_album) {
+			info.artist = song_info.artist;
+			info.album = song_info.album;
+		}
+
+		if(!title.empty()) {
+			info.title = title;
+
+			// `Artist - Title`, most likely
+			if(title.find(" - ") != std::string::npos)
+				info.artist.clear();
+		} else if(!info.artist.empty()) {
+			info.title = TitleFromFileName(FileNameOf(path));
+		}
+
+		next_entry = id;
+		next_song_info = info;
+		next_filename = FileNameOf(path);
+		next_large_image = same_album ? large_image : std::string();
+
+		PresenceSnapshot snapshot;
+		snapshot.state = paused ? PlayerState::Paused : PlayerState::Playing;
+		snapshot.speed = speed;
+		CopyField(snapshot.artist, next_song_info.artist);
+		CopyField(snapshot.title, next_song_info.title);
+		CopyField(snapshot.album, next_song_info.album);
+		CopyField(snapshot.filename, next_filename);
+		CopyField(snapshot.large_image, next_large_image);
+		snapshot.predicted_entry = id;
+
+		// rendered by the runner on its next tick, well before this file ends
+		next_snapshot.Store(snapshot);
+	}
+
+	void DiscordPlugin::SwitchToNext() {
+		MDRPC_TRACE_SPAN("DiscordPlugin::SwitchToNext");
+
+		song_info = next_song_info;
+		cached_filename = next_filename;
+		large_image = next_large_image;
+		predicted_entry = next_entry;
+
+		// the new file starts from the top; its duration is not known yet
+		idle = false;
+		duration = -1.0;
+		anchor_position = 0.0;
+		anchor_unix = Utils::Clock::UnixNow();
+		anchor_stale = false;
+		std::atomic_store(&chapters, std::shared_ptr<const ChapterIndex>());
+
+		PublishSnapshot();
+	}
+
+	PlayerState DiscordPlugin::GetPlayerState() const {
+		if(idle)
+			return PlayerState::Idle;
+
+		if(buffering)
+			return PlayerState::Buffering;
+
+		if(paused)
+			return PlayerState::Paused;
+
+		return PlayerState::Playing;
+	}
+
+	void DiscordPlugin::Debounce() {
+		settled = false;
+		anchor_stale = true;
+		settle_pending = true;
+		settle_deadline = Utils::Clock::Now();
+
+		// Nothing is shown yet, so there is nothing to flicker; show the first file right away.
+		if(first_presence_queued)
+			settle_deadline += std::chrono::milliseconds(options.settle_ms);
+	}
+
+	double DiscordPlugin::WaitTimeout() const {
+		if(!settle_pending)
+			return -1.0;
+
+		auto remaining = std::chrono::duration<double>(settle_deadline - Utils::Clock::Now()).count();
+		return remaining > 0.0 ? remaining : 0.0;
+	}
+
+	void DiscordPlugin::Update() {
+		// Discord wakes us up (see WakeEventLoop()) whenever it has something for us.
+		{
+			MDRPC_TRACE_SPAN("Discord_RunCallbacks");
+			Discord_RunCallbacks();
+		}
+
+		FlushLog();
+
+		if(!settle_pending || Utils::Clock::Now() < settle_deadline)
+			return;
+
+		settle_pending = false;
+
+		if(load_pending) {
+			load_pending = false;
+
+			{
+				MDRPC_TRACE_SPAN("fetch filename");
+
+				// metadata itself is observed, so only the filename needs fetching
+				cached_filename = ModernMPV::Properties::get_osd_string(mpvHandle, "filename");
+			}
+
+			// Without the debounce the metadata change usually hasn't come in yet
+			// (mpv only sends property changes once its event queue is empty).
+			if(!first_presence_queued) {
+				MDRPC_TRACE_SPAN("fetch metadata");
+				ModernMPV::Properties::get_node_map_raw(mpvHandle, "metadata", [&](mpv_node node) {
+					MetadataChanged(&node);
+				});
+			}
+
+			{
+				// once per file; the Discord runner finds the current chapter from the position
+				MDRPC_TRACE_SPAN("load chapters");
+				std::atomic_store(&chapters, ChapterIndex::Load(mpvHandle));
+			}
+
+			PrepareNext();
+		}
+
+		settled = true;
+		PublishSnapshot();
+
+		// The runner lives across files; only start it the first time around.
+		if(!discord_runner.Running()) {
+			discord_runner.Start(1500, [&]() {
+				RpcThreadInterval();
+			}, [&]() {
+				// Initalize discord
+				RpcThreadInit();
+			});
+		}
+	}
+
+#ifdef MDRPC_VIRTUAL_CLOCK
+	Utils::Clock::time_point DiscordPlugin::NextDue() const {
+		auto due = Utils::Clock::time_point::max();
+
+		if(settle_pending)
+			due = std::min(due, settle_deadline);
+
+		if(discord_runner.Running())
+			due = std::min(due, discord_runner.NextDue());
+
+		return due;
+	}
+
+	void DiscordPlugin::RunDue() {
+		Update();
+		discord_runner.Poll();
+	}
+#endif
+
 	void DiscordPlugin::RpcThreadInit() {
 		using namespace std::placeholders;
 		
-		DiscordEventHandlers handlers;
-		memset(&handlers, 0, sizeof(DiscordEventHandlers));
+		DiscordEventHandlers handlers {};
 		handlers.ready = std::bind(&DiscordPlugin::DiscordReady, this, _1);
 		handlers.disconnected = std::bind(&DiscordPlugin::DiscordDisconnect, this, _1, _2);
 		handlers.errored = std::bind(&DiscordPlugin::DiscordError, this, _1, _2);
 
-		Discord_Initialize(discord_appid, &handlers, 1, NULL);
+		// Runs once per plugin lifetime (the runner lives across files), and registering
+		// is skipped by discord-rpc if it is already in place, so this never forks per file.
+		Discord_SetEventNotify(&DiscordPlugin::WakeEventLoop, this);
+		discord_initialized = Utils::Clock::Now();
+		Discord_Initialize(discord_appid, &handlers, options.discord_register ? 1 : 0, NULL);
 #ifdef DISCORD_DISABLE_IO_THREAD
 		Discord_UpdateConnection();
 #endif
 	}
 
 	void DiscordPlugin::RpcThreadInterval() {
-		static DiscordRichPresence rpc;
-		rpc.largeImageKey = discord_large;
-		rpc.largeImageText = "mpv";
+		MDRPC_TRACE_SPAN("DiscordPlugin::RpcThreadInterval");
+
+		RenderNext();
+		PublishPresence();
 
-		auto state = Utils::StringToC(GetState());
-		auto song = Utils::StringToC(GetSong());
+		if(!first_presence_reported) {
+			auto discord_ms = Discord_GetTimeToFirstPresence();
 
-		rpc.details = state.data();
-		rpc.state = song.data();
+			if(discord_ms >= 0) {
+				first_presence_reported = true;
+
+				auto init_ms = std::chrono::duration_cast<std::chrono::milliseconds>(discord_initialized - first_load).count();
+				MDRPC_LOG_INFO("time to first presence: %lld ms after the first file loaded (%d ms after Discord_Initialize)",
+					static_cast<long long>(init_ms + discord_ms), discord_ms);
+			}
+		}
 
-		Discord_UpdatePresence(&rpc);
-		Discord_RunCallbacks();
 #ifdef DISCORD_DISABLE_IO_THREAD
 		Discord_UpdateConnection();
 #endif
 	}
 
-	void DiscordPlugin::DiscordReady(const DiscordUser* user) {
-		std::cout << "mdrpc: Discord connected (" << user->username << "#" << user->discriminator << ")\n";
+	void DiscordPlugin::PublishPresence() {
+		MDRPC_TRACE_SPAN("DiscordPlugin::PublishPresence");
+		static DiscordRichPresence rpc;
+
+		auto snapshot = presence_snapshot.Load();
+
+		// Don't publish anything while the player is still skipping/seeking around, except the
+		// prediction for the file that is loading: FILE_LOADED may well have come in (and started
+		// the settle window) before we got to it, and it stays in place until the file settled.
+		if(!settled && snapshot.predicted_entry == 0)
+			return;
+
+		PresenceData presence;
+		if(snapshot.predicted_entry != 0 && RendersSame(snapshot, prepared_snapshot)) {
+			// rendered by RenderNext() while the previous file was still playing
+			presence = prepared_presence;
+		} else {
+			MDRPC_TRACE_SPAN("format presence");
+			presence = RenderPresence(snapshot, std::atomic_load(&chapters).get());
+		}
+		presence.timeline = snapshot.timeline;
+
+		// Discord renders the progress itself from the timestamps,
+		// so during normal playback there is nothing new to send.
+		if(!presence.Matches(last_presence)) {
+			auto state = Utils::StringToC(presence.details);
+			auto song = Utils::StringToC(presence.state);
+			auto large_text = Utils::StringToC(presence.large_text);
+
+			rpc.largeImageKey = presence.large_image.c_str();
+			rpc.largeImageText = large_text.data();
+			rpc.details = state.data();
+			rpc.state = song.data();
+			rpc.startTimestamp = presence.timeline.start;
+			rpc.endTimestamp = presence.timeline.end;
+
+			Discord_UpdatePresence(&rpc);
+			last_presence = presence;
+			first_presence_queued = true;
+
+			MDRPC_LOG_VERBOSE("presence: %s | %s", rpc.details, rpc.state);
+		}
 	}
 
-	void DiscordPlugin::DiscordDisconnect(int error, const char* reason) {
-		std::cout << "mdrpc: Discord disconnected (" << error << " \"" << reason << "\"\n";
+	void DiscordPlugin::RenderNext() {
+		auto next = next_snapshot.Load();
+
+		if(next.predicted_entry == 0 || RendersSame(next, prepared_snapshot))
+			return;
+
+		MDRPC_TRACE_SPAN("render next presence");
+		prepared_presence = RenderPresence(next, nullptr);
+		prepared_snapshot = next;
 	}
 
-	void DiscordPlugin::DiscordError(int error, const char* reason) {
-		std::cout << "mdrpc: Discord error (" << error << " \"" << reason << "\"\n";
+	PresenceData DiscordPlugin::RenderPresence(const PresenceSnapshot& snapshot, const ChapterIndex* chapters) {
+		PresenceData presence;
+		presence.details = GetState(snapshot);
+		presence.state = GetSong(snapshot, chapters);
+		presence.large_text = snapshot.album[0] ? snapshot.album : "mpv";
+		presence.large_image = snapshot.large_image[0] ? snapshot.large_image : discord_large;
+		return presence;
 	}
 
-	void DiscordPlugin::StateThreadInterval() {
-		ModernMPV::Properties::get_bool(mpvHandle, "pause", [&](bool Value) {
-			if(Value)
-				current_state = PlayerState::Paused;
-			else
-				current_state = PlayerState::Playing;
-		});
+	void DiscordPlugin::FlushLog() {
+		Log::Drain(PrintLog, this);
+	}
 
-		ModernMPV::Properties::get_bool(mpvHandle, "paused-for-cache", [&](bool Value) {
-			if(Value)
-				current_state = PlayerState::Buffering;
-		});
+	void DiscordPlugin::PrintLog(void* self, Log::Level level, const char* text) {
+		// Clients can only print through mpv at info level (print-text), so the level
+		// goes into the text, where it can still be told apart (and grepped for).
+		char line[272];
+		std::snprintf(line, sizeof(line), "mdrpc: [%s] %s", Log::LevelName(level), text);
+
+		const char* args[] = { "print-text", line, nullptr };
+		mpv_command(static_cast<DiscordPlugin*>(self)->mpvHandle, args);
 	}
 
-	std::string DiscordPlugin::GetState() {
-		std::stringstream stream;
-		stream << current_states[current_state] << ' ' << '(';
+	void DiscordPlugin::WakeEventLoop(void* self) {
+		mpv_wakeup(static_cast<DiscordPlugin*>(self)->mpvHandle);
+	}
 
-		double speed;
-		ModernMPV::Properties::get_double(mpvHandle, "speed", [&](double v) {
-			speed = v;
-		});
+	void DiscordPlugin::DiscordReady(const DiscordUser* user) {
+		// discord-rpc hands the last presence to (re)connecting clients itself.
+		MDRPC_LOG_INFO("Discord connected (%s#%s)", user->username, user->discriminator);
+	}
 
-		stream << ModernMPV::Properties::get_osd_string(mpvHandle, "time-pos") << '/';
-		stream << ModernMPV::Properties::get_osd_string(mpvHandle, "duration");
+	void DiscordPlugin::DiscordDisconnect(int error, const char* reason) {
+		MDRPC_LOG_INFO("Discord disconnected (%d \"%s\")", error, reason);
+	}
+
+	void DiscordPlugin::DiscordError(int error, const char* reason) {
+		MDRPC_LOG_ERROR("Discord error (%d \"%s\")", error, reason);
+	}
+
+	std::string DiscordPlugin::GetState(const PresenceSnapshot& snapshot) {
+		std::stringstream stream;
+		stream << current_states[snapshot.state];
 
-		if(speed != 1.0)
-			stream << ' ';
+		if(snapshot.speed != 1.0)
+			stream << ' ' << '(';
 
-		if(Utils::AddIf(stream, speed, [](double v) { return v == 1.0; })) {
-			stream << 'x';
+		if(Utils::AddIf(stream, snapshot.speed, [](double v) { return v == 1.0; })) {
+			stream << 'x' << ')';
 		}
 
-		stream << ')';
-
 		return stream.str();
 	}
 
-	std::string DiscordPlugin::GetSong() {
-		constexpr std::array<const char*, 2> artist_keys = {{
-			"artist",
-			"ARTIST"
-		}};
+	void DiscordPlugin::Anchor() {
+		// Playback runs at a steady pace in between seeks, pauses and speed changes,
+		// so the position only needs to be read again after one of those.
+		if(!anchor_stale)
+			return;
 
-		constexpr std::array<const char*, 3> title_keys = {{
-			"title",
-			"TITLE",
-			"icy-title"
-		}};
+		MDRPC_TRACE_SPAN("mpv_get_property time-pos");
+		anchor_position = -1.0;
 
-		constexpr std::array<const char*, 2> album_keys = {{
-			"album",
-			"ALBUM"
-		}};
+		ModernMPV::Properties::get_double(mpvHandle, "time-pos", [&](double v) {
+			anchor_position = v;
+		});
 
-		std::string artist;
-		std::string title;
+		anchor_unix = Utils::Clock::UnixNow();
+		anchor_stale = anchor_position < 0.0;
+	}
 
-		for(const char* key : artist_keys) {
-			if(cached_metadata.find(key) == cached_metadata.end())
-				continue;
+	Timeline DiscordPlugin::GetTimeline(PlayerState state) const {
+		Timeline timeline;
 
-			auto artist_ = ModernMPV::Properties::get_node_string(cached_metadata[key]);
+		// A paused or stalled player has no meaningful end time.
+		if(state != PlayerState::Playing || speed <= 0.0 || anchor_position < 0.0)
+			return timeline;
 
-			if(artist_.empty())
-				continue;
+		timeline.start = static_cast<std::int64_t>(std::llround(anchor_unix - anchor_position / speed));
 
-			artist = artist_;
-		}
+		if(duration > 0.0)
+			timeline.end = static_cast<std::int64_t>(std::llround(anchor_unix + (duration - anchor_position) / speed));
 
-		for(const char* key : title_keys) {
-			if(cached_metadata.find(key) == cached_metadata.end())
-				continue;
+		return timeline;
+	}
 
-			auto title_ = ModernMPV::Properties::get_node_string(cached_metadata[key]);
+	bool PresenceData::Matches(const PresenceData& other) const {
+		auto near = [](std::int64_t a, std::int64_t b) {
+			if(a == 0 || b == 0)
+				return a == b;
 
-			if(title_.empty())
-				continue;
+			return std::llabs(a - b) <= 1;
+		};
 
-			title = title_;
-		}
+		return details == other.details
+			&& state == other.state
+			&& large_text == other.large_text
+			&& large_image == other.large_image
+			&& near(timeline.start, other.timeline.start)
+			&& near(timeline.end, other.timeline.end);
+	}
 
+	std::string DiscordPlugin::GetSong(const PresenceSnapshot& snapshot, const ChapterIndex* chapters) {
 		std::stringstream stream;
 
-		if(artist.empty() && title.empty())
-			stream << cached_filename;
-		else if(artist.empty())
-			stream << title;
+		if(!snapshot.artist[0] && !snapshot.title[0])
+			stream << snapshot.filename;
+		else if(!snapshot.artist[0])
+			stream << snapshot.title;
 		else
-			stream << artist << " - " << title;
+			stream << snapshot.artist << " - " << snapshot.title;
+
+		if(chapters && snapshot.position >= 0.0) {
+			auto position = snapshot.position;
+
+			if(snapshot.state == PlayerState::Playing)
+				position += (Utils::Clock::UnixNow() - snapshot.position_unix) * snapshot.speed;
+
+			auto chapter = chapters->Find(position);
+
+			if(chapter >= 0)
+				stream << ": " << chapters->Title(chapter);
+		}
 
 		return stream.str();
 	}
@@ -3,6 +3,17 @@
 #include "Utils.hpp"
 #include "IntervalRunner.hpp"
 #include "ModernMPV.hpp"
+#include "Options.hpp"
+#include "Clock.hpp"
+#include "Seqlock.hpp"
+#include "Chapters.hpp"
+#include "AssetIndex.hpp"
+#include "History.hpp"
+#include "Log.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
 
 #include <discord_rpc.h>
 
@@ -23,6 +34,112 @@ namespace mdrpc LOCAL_SYM {
 		Count_
 	};
 
+	/**
+	 * Wall-clock playback timeline, in the form Discord expects it.
+	 * A zero timestamp means "unknown" and is not sent.
+	 */
+	struct Timeline {
+		/**
+		 * Unix time (in seconds) the current file would have started at.
+		 */
+		std::int64_t start = 0;
+
+		/**
+		 * Unix time (in seconds) the current file will end at.
+		 */
+		std::int64_t end = 0;
+	};
+
+	/**
+	 * The metadata fields mdrpc actually uses, resolved from mpv's `metadata` map.
+	 */
+	struct SongInfo {
+		std::string artist;
+		std::string title;
+		std::string album;
+
+		bool operator==(const SongInfo& other) const {
+			return artist == other.artist && title == other.title && album == other.album;
+		}
+
+		bool operator!=(const SongInfo& other) const {
+			return !(*this == other);
+		}
+	};
+
+	/**
+	 * Reply IDs for properties we observe with mpv_observe_property().
+	 */
+	enum ObservedProperty : std::uint64_t {
+		Metadata = 1,
+		Pause,
+		PausedForCache,
+		Speed,
+		Duration,
+		Path
+	};
+
+	/**
+	 * Everything the Discord runner needs to know about the player.
+	 * Written by the mpv thread and published as a whole through a Seqlock,
+	 * so the Discord runner always reads a consistent copy.
+	 *
+	 * Strings are cut (at a UTF-8 boundary) to fit; Discord cuts them a lot shorter anyway.
+	 */
+	struct PresenceSnapshot {
+		PlayerState state = PlayerState::Idle;
+		double speed = 1.0;
+		Timeline timeline;
+
+		/**
+		 * Playback position at position_unix, or -1 if unknown.
+		 * Moves on at `speed` from there while playing.
+		 */
+		double position = -1.0;
+		double position_unix = 0.0;
+
+		char artist[256] = {};
+		char title[256] = {};
+		char album[256] = {};
+		char filename[256] = {};
+
+		/**
+		 * Asset key for the large image, or empty for the default.
+		 */
+		char large_image[128] = {};
+
+		/**
+		 * Playlist entry ID if this is a prediction for an entry that has not loaded yet
+		 * (see DiscordPlugin::PrepareNext()), otherwise 0.
+		 */
+		std::int64_t predicted_entry = 0;
+	};
+
+	/**
+	 * Everything that ends up in a presence update.
+	 * Kept around so we only talk to Discord when something actually changed.
+	 */
+	struct PresenceData {
+		std::string details;
+		std::string state;
+		std::string large_text;
+		std::string large_image;
+		Timeline timeline;
+
+		/**
+		 * Returns true if the two presences would render the same in Discord.
+		 * Timestamps are allowed to drift by a second, since they are recomputed
+		 * from the playback position every interval.
+		 */
+		bool Matches(const PresenceData& other) const;
+	};
+
+#ifdef MDRPC_VIRTUAL_CLOCK
+	using Runner = Utils::ManualIntervalRunner;
+#else
+	using Runner = Utils::IntervalRunner;
+#endif
+
 	struct DiscordPlugin {
 
 		DiscordPlugin(mpv_handle* handle);
@@ -35,6 +152,50 @@ namespace mdrpc LOCAL_SYM {
 		 */
 		void ProcessEvent(mpv_event* ev);
 
+		/**
+		 * Runs Discord callbacks, and any work that was deferred until the player settled.
+		 * Should be called after every mpv_wait_event(), including timeouts and wakeups.
+		 */
+		void Update();
+
+		/**
+		 * Returns the timeout to pass to mpv_wait_event() so that Update()
+		 * is called in time for deferred work, or -1 if there is none pending.
+		 */
+		double WaitTimeout() const;
+
+		/**
+		 * Prints the log messages queued by any thread through mpv.
+		 * Only ever call this from the mpv thread.
+		 */
+		void FlushLog();
+
+		/**
+		 * Returns the options the plugin was started with.
+		 */
+		const Options& GetOptions() const {
+			return options;
+		}
+
+		/**
+		 * Returns mpv's `msg-level` option as the plugin read it when it was created.
+		 */
+		const std::map<std::string, std::string>& GetMsgLevels() const {
+			return msg_levels;
+		}
+
+#ifdef MDRPC_VIRTUAL_CLOCK
+		/**
+		 * Returns the (virtual) point in time some deferred or interval work is next due at.
+		 */
+		Utils::Clock::time_point NextDue() const;
+
+		/**
+		 * Runs all deferred and interval work that is due at the current virtual time.
+		 */
+		void RunDue();
+#endif
+
 
 		/**
 		 * Handle to mpv.
@@ -58,6 +219,43 @@ namespace mdrpc LOCAL_SYM {
 		 */
 		void RpcThreadInterval();
 
+		/**
+		 * Sends the current presence to Discord, if it changed since it was last sent.
+		 */
+		void PublishPresence();
+
+		/**
+		 * Renders the presence PrepareNext() predicted for the next playlist entry,
+		 * unless it already was, so PublishPresence() has it ready when that entry starts.
+		 */
+		void RenderNext();
+
+		/**
+		 * Renders a snapshot into everything that is sent to Discord but the timeline.
+		 *
+		 * \param[in] snapshot Snapshot to render
+		 * \param[in] chapters Chapters of the file, or nullptr
+		 */
+		static PresenceData RenderPresence(const PresenceSnapshot& snapshot, const ChapterIndex* chapters);
+
+
+		/**
+		 * Wakes up the mpv event loop so it runs Discord callbacks and prints log messages.
+		 * Called by discord-rpc (on its IO thread) whenever it queues an event,
+		 * and by the log whenever a message is queued.
+		 *
+		 * \param[in] self The plugin
+		 */
+		static void WakeEventLoop(void* self);
+
+		/**
+		 * Prints a log message through mpv, for FlushLog().
+		 *
+		 * \param[in] self The plugin
+		 * \param[in] level Message level
+		 * \param[in] text Message
+		 */
+		static void PrintLog(void* self, Log::Level level, const char* text);
 
 		/**
 		 * Callback for when Discord is ready.
@@ -77,44 +275,304 @@ namespace mdrpc LOCAL_SYM {
 		/** @} */
 
 		/**
-		 * Updates the current player state.
+		 * Handles a change of one of the observed playback properties.
+		 *
+		 * \param[in] id Which property changed
+		 * \param[in] prop The change
+		 */
+		void PlaybackChanged(std::uint64_t id, const mpv_event_property* prop);
+
+		/**
+		 * Handles a change of the observed `metadata` property.
+		 * Only the keys we use are looked at, and presence is only
+		 * updated if they resolve to something different than before.
+		 *
+		 * \param[in] node New value of the property
+		 */
+		void MetadataChanged(const mpv_node* node);
+
+		/**
+		 * Starts recording a play of the file that was just loaded into the listening history.
+		 */
+		void BeginPlay();
+
+		/**
+		 * Finishes the current play, if any, and hands it to the history writer.
+		 *
+		 * \param[in] reason Why playback ended (an mpv_end_file_reason)
+		 */
+		void EndPlay(std::int32_t reason);
+
+		/**
+		 * Starts or stops counting paused time for the current play, following `paused`.
+		 */
+		void TrackPause();
+
+		/**
+		 * Defers filename fetching and presence publishing until the player
+		 * has not changed file or seeked for the configured settle window.
+		 */
+		void Debounce();
+
+		/**
+		 * Builds a new PresenceSnapshot from what the mpv thread knows and publishes it
+		 * to the Discord runner. Does nothing while the player is still settling;
+		 * Update() publishes once it settled. Predictions (see SwitchToNext()) are published regardless.
+		 */
+		void PublishSnapshot();
+
+		/**
+		 * Predicts the presence of the next playlist entry from what the playlist knows about it
+		 * (its filename and title, plus the current artist and album if it is in the same directory),
+		 * and hands it to the Discord runner to render while the current file plays.
+		 * Called once per file, after it settled.
+		 */
+		void PrepareNext();
+
+		/**
+		 * Switches over to the presence PrepareNext() predicted and publishes it right away,
+		 * without waiting for the file to load. The file's own metadata replaces it once it is in.
+		 */
+		void SwitchToNext();
+
+		/**
+		 * Returns the current player state, derived from the observed properties.
+		 */
+		PlayerState GetPlayerState() const;
+
+		/**
+		 * Re-reads the playback position if it may have jumped since it was last read.
+		 */
+		void Anchor();
+
+		/**
+		 * Computes the wall-clock timeline of the current file from the anchored position.
+		 *
+		 * \param[in] state Current player state
+		 */
+		Timeline GetTimeline(PlayerState state) const;
+
+		/**
+		 * Returns the state in a human readable fashion.
+		 *
+		 * \param[in] snapshot Snapshot to describe
 		 */
-		void StateThreadInterval();
+		static std::string GetState(const PresenceSnapshot& snapshot);
 
 		/**
-		 * Returns the current state in a human readable fashion.
+		 * Returns the formatted song metadata (or filename if metadata does not exist),
+		 * followed by the current chapter if the file has chapters.
+		 *
+		 * \param[in] snapshot Snapshot to describe
+		 * \param[in] chapters Chapters of the file, or nullptr
 		 */
-		std::string GetState();
+		static std::string GetSong(const PresenceSnapshot& snapshot, const ChapterIndex* chapters);
 
 		/**
-		 * Returns the formatted song metadata (or filename if metadata does not exist).
+		 * The presence as last published by the mpv thread.
+		 */
+		Utils::Seqlock<PresenceSnapshot> presence_snapshot;
+
+		/**
+		 * Chapters of the file that is currently playing, or nullptr.
+		 * Replaced as a whole (with std::atomic_store()) by the mpv thread once per file,
+		 * so the Discord runner can keep using the one it loaded.
+		 */
+		std::shared_ptr<const ChapterIndex> chapters;
+
+		/**
+		 * \defgroup MpvThreadState State only touched by the mpv thread
+		 * @{
 		 */
-		std::string GetSong();
 
 		/**
-		 * Cached file metadata for file that is currently playing.
+		 * Resolved metadata for file that is currently playing.
 		 */ 
-		std::map<std::string, mpv_node> cached_metadata;
+		SongInfo song_info;
 
 		/**
 		 * Cached filename.
 		 */
 		std::string cached_filename;
 
+		/**
+		 * Asset key for the artist/album that is currently playing, or empty for the default.
+		 */
+		std::string large_image;
+
+		/**
+		 * The user's artist/album asset index, if they configured one.
+		 */
+		AssetIndex asset_index;
+
+		/**
+		 * Writes the listening history, if the user wants one.
+		 */
+		History::Writer history;
+
+		/**
+		 * The play being recorded for the listening history. Its path is kept
+		 * up to date from the observed `path` property, the rest is filled in by EndPlay().
+		 */
+		History::Play current_play;
+
+		/**
+		 * Set while current_play is being recorded (from FILE_LOADED to END_FILE).
+		 */
+		bool play_active = false;
+
+		/**
+		 * Unix time the current play was paused at, or 0 while it is not paused.
+		 */
+		double pause_started_unix = 0.0;
+
+		/**
+		 * Set while mpv has nothing loaded.
+		 */
+		bool idle = false;
+
+		/**
+		 * Value of the `pause` property.
+		 */
+		bool paused = false;
+
+		/**
+		 * Value of the `paused-for-cache` property.
+		 */
+		bool buffering = false;
+
+		/**
+		 * Value of the `speed` property.
+		 */
+		double speed = 1.0;
+
+		/**
+		 * Value of the `duration` property, or -1 if unknown.
+		 */
+		double duration = -1.0;
+
+		/**
+		 * Playback position the timeline is anchored at, or -1 if unknown.
+		 */
+		double anchor_position = -1.0;
+
+		/**
+		 * Unix time at which playback was at anchor_position.
+		 */
+		double anchor_unix = 0.0;
+
+		/**
+		 * Set when the position may have jumped (or changed pace) since the timeline was anchored.
+		 */
+		bool anchor_stale = true;
+
+		/** @} */
+
+		/**
+		 * The last presence sent to Discord.
+		 */
+		PresenceData last_presence;
+
+
+		/**
+		 * \defgroup NextPresence Next playlist entry
+		 * @{
+		 */
+
+		/**
+		 * Playlist entry ID PrepareNext() predicted a presence for, or 0.
+		 * This and the predicted values below are only touched by the mpv thread.
+		 */
+		std::int64_t next_entry = 0;
+		SongInfo next_song_info;
+		std::string next_filename;
+		std::string next_large_image;
+
+		/**
+		 * Playlist entry ID of the prediction SwitchToNext() switched to, until the file
+		 * loaded (or failed to), otherwise 0. Snapshots published meanwhile are marked with it,
+		 * so the Discord runner sends them even if the file is already settling by the time
+		 * it gets to them, and the old file's metadata going away does not replace the prediction.
+		 */
+		std::int64_t predicted_entry = 0;
+
+		/**
+		 * The predicted presence, as published by PrepareNext().
+		 */
+		Utils::Seqlock<PresenceSnapshot> next_snapshot;
+
+		/**
+		 * The prediction RenderNext() last rendered, and what it rendered to.
+		 * Only touched by the Discord runner.
+		 */
+		PresenceSnapshot prepared_snapshot;
+		PresenceData prepared_presence;
+
+		/** @} */
+
 		/**
 		 * Interval runner for Discord.
 		 */
-		Utils::IntervalRunner discord_runner;
+		Runner discord_runner;
+
+		/**
+		 * User options.
+		 */
+		Options options;
 
 		/**
-		 * Interval runner for updating states.
+		 * Value of mpv's `msg-level` option when the plugin was created.
 		 */
-		Utils::IntervalRunner state_runner;
+		std::map<std::string, std::string> msg_levels;
 
 		/**
-		 * The current player state.
+		 * Point in time deferred work will run at, if settle_pending is set.
 		 */
-		PlayerState current_state;
+		Utils::Clock::time_point settle_deadline;
+
+		/**
+		 * Set if there is deferred work waiting for the player to settle.
+		 */
+		bool settle_pending = false;
+
+		/**
+		 * Set if a file was loaded and its filename has not been fetched yet.
+		 */
+		bool load_pending = false;
+
+		/**
+		 * Cleared while the player is still settling, so the Discord runner
+		 * does not publish presence for a file we are about to skip past.
+		 */
+		std::atomic_bool settled { false };
+
+		/**
+		 * Set once the Discord runner queued its first presence. Until then, the player
+		 * is not debounced, so the first file shows up as soon as it is loaded.
+		 */
+		std::atomic_bool first_presence_queued { false };
+
+		/**
+		 * \defgroup FirstPresence Time to first presence
+		 * @{
+		 */
+
+		/**
+		 * When the first file was loaded. Only set by the mpv thread, before the Discord runner starts.
+		 */
+		Utils::Clock::time_point first_load;
+
+		/**
+		 * When Discord was initialized. Only touched by the Discord runner.
+		 */
+		Utils::Clock::time_point discord_initialized;
+
+		/**
+		 * Set once the time to first presence was logged. Only touched by the Discord runner.
+		 */
+		bool first_presence_reported = false;
+
+		/** @} */
 	};
 
 }
@@ -0,0 +1,476 @@
+#include "EventTrace.hpp"
+
+#include <cstring>
+
+#ifdef DOXYGEN
+namespace mdrpc {
+#else
+namespace mdrpc LOCAL_SYM {
+#endif
+
+namespace EventTrace {
+
+	/**
+	 * Deepest node tree we will read back, to keep corrupt traces from blowing the stack.
+	 */
+	constexpr static int max_node_depth = 64;
+
+	static void PutUInt(std::vector<std::uint8_t>& out, std::uint64_t value) {
+		while(value >= 0x80) {
+			out.push_back(static_cast<std::uint8_t>(value | 0x80));
+			value >>= 7;
+		}
+		out.push_back(static_cast<std::uint8_t>(value));
+	}
+
+	static void PutInt(std::vector<std::uint8_t>& out, std::int64_t value) {
+		PutUInt(out, (static_cast<std::uint64_t>(value) << 1) ^ static_cast<std::uint64_t>(value >> 63));
+	}
+
+	static void PutDouble(std::vector<std::uint8_t>& out, double value) {
+		std::uint8_t raw[sizeof(double)];
+		memcpy(raw, &value, sizeof(double));
+		out.insert(out.end(), raw, raw + sizeof(double));
+	}
+
+	static void PutString(std::vector<std::uint8_t>& out, const char* str) {
+		auto len = str ? strlen(str) : 0;
+		PutUInt(out, len);
+		out.insert(out.end(), str, str + len);
+	}
+
+	static void PutValue(std::vector<std::uint8_t>& out, const Value& value) {
+		PutUInt(out, value.format);
+
+		switch(value.format) {
+			case MPV_FORMAT_FLAG:
+			case MPV_FORMAT_INT64:
+				PutInt(out, value.integer);
+				break;
+
+			case MPV_FORMAT_DOUBLE:
+				PutDouble(out, value.number);
+				break;
+
+			case MPV_FORMAT_STRING:
+			case MPV_FORMAT_OSD_STRING:
+				PutString(out, value.string.c_str());
+				break;
+
+			case MPV_FORMAT_NODE_MAP:
+			case MPV_FORMAT_NODE_ARRAY:
+				PutUInt(out, value.children.size());
+				for(std::size_t i = 0; i < value.children.size(); ++i) {
+					if(value.format == MPV_FORMAT_NODE_MAP)
+						PutString(out, value.keys[i].c_str());
+					PutValue(out, value.children[i]);
+				}
+				break;
+
+			default:
+				break;
+		}
+	}
+
+	static bool GetUInt(std::FILE* file, std::uint64_t& value) {
+		value = 0;
+
+		for(int shift = 0; shift < 64; shift += 7) {
+			int c = std::fgetc(file);
+			if(c == EOF)
+				return false;
+
+			value |= static_cast<std::uint64_t>(c & 0x7f) << shift;
+			if(!(c & 0x80))
+				return true;
+		}
+
+		return false;
+	}
+
+	static bool GetInt(std::FILE* file, std::int64_t& value) {
+		std::uint64_t raw;
+		if(!GetUInt(file, raw))
+			return false;
+
+		value = static_cast<std::int64_t>(raw >> 1) ^ -static_cast<std::int64_t>(raw & 1);
+		return true;
+	}
+
+	static bool GetDouble(std::FILE* file, double& value) {
+		return std::fread(&value, sizeof(double), 1, file) == 1;
+	}
+
+	static bool GetString(std::FILE* file, std::string& str) {
+		std::uint64_t len;
+		if(!GetUInt(file, len) || len > (1u << 24))
+			return false;
+
+		str.resize(len);
+		return len == 0 || std::fread(&str[0], 1, len, file) == len;
+	}
+
+	static bool GetValue(std::FILE* file, Value& value, int depth = 0) {
+		std::uint64_t format;
+		if(depth > max_node_depth || !GetUInt(file, format))
+			return false;
+
+		value.format = static_cast<mpv_format>(format);
+
+		switch(value.format) {
+			case MPV_FORMAT_FLAG:
+			case MPV_FORMAT_INT64:
+				return GetInt(file, value.integer);
+
+			case MPV_FORMAT_DOUBLE:
+				return GetDouble(file, value.number);
+
+			case MPV_FORMAT_STRING:
+			case MPV_FORMAT_OSD_STRING:
+				return GetString(file, value.string);
+
+			case MPV_FORMAT_NODE_MAP:
+			case MPV_FORMAT_NODE_ARRAY: {
+				std::uint64_t count;
+				if(!GetUInt(file, count) || count > (1u << 24))
+					return false;
+
+				value.children.resize(count);
+				if(value.format == MPV_FORMAT_NODE_MAP)
+					value.keys.resize(count);
+
+				for(std::uint64_t i = 0; i < count; ++i) {
+					if(value.format == MPV_FORMAT_NODE_MAP && !GetString(file, value.keys[i]))
+						return false;
+
+					if(!GetValue(file, value.children[i], depth + 1))
+						return false;
+				}
+				return true;
+			}
+
+			case MPV_FORMAT_NONE:
+				return true;
+
+			default:
+				return false;
+		}
+	}
+
+	Value Value::FromNode(const mpv_node& node) {
+		Value value;
+		value.format = node.format;
+
+		switch(node.format) {
+			case MPV_FORMAT_FLAG:
+				value.integer = node.u.flag;
+				break;
+
+			case MPV_FORMAT_INT64:
+				value.integer = node.u.int64;
+				break;
+
+			case MPV_FORMAT_DOUBLE:
+				value.number = node.u.double_;
+				break;
+
+			case MPV_FORMAT_STRING:
+				value.string = node.u.string ? node.u.string : "";
+				break;
+
+			case MPV_FORMAT_NODE_MAP:
+			case MPV_FORMAT_NODE_ARRAY:
+				value.children.reserve(node.u.list->num);
+				for(int i = 0; i < node.u.list->num; ++i) {
+					if(node.format == MPV_FORMAT_NODE_MAP)
+						value.keys.push_back(node.u.list->keys[i]);
+					value.children.push_back(FromNode(node.u.list->values[i]));
+				}
+				break;
+
+			default:
+				// byte arrays are never read by mdrpc
+				value.format = MPV_FORMAT_NONE;
+				break;
+		}
+
+		return value;
+	}
+
+	Value Value::FromStringMap(const std::map<std::string, std::string>& map) {
+		Value value;
+		value.format = MPV_FORMAT_NODE_MAP;
+		value.keys.reserve(map.size());
+		value.children.reserve(map.size());
+
+		for(auto& entry : map) {
+			Value child;
+			child.format = MPV_FORMAT_STRING;
+			child.string = entry.second;
+
+			value.keys.push_back(entry.first);
+			value.children.push_back(std::move(child));
+		}
+
+		return value;
+	}
+
+	Value Value::FromData(mpv_format format, const void* data) {
+		Value value;
+		value.format = format;
+
+		switch(format) {
+			case MPV_FORMAT_FLAG:
+				value.integer = *static_cast<const int*>(data);
+				break;
+
+			case MPV_FORMAT_INT64:
+				value.integer = *static_cast<const std::int64_t*>(data);
+				break;
+
+			case MPV_FORMAT_DOUBLE:
+				value.number = *static_cast<const double*>(data);
+				break;
+
+			case MPV_FORMAT_STRING:
+			case MPV_FORMAT_OSD_STRING: {
+				auto str = *static_cast<char* const*>(data);
+				value.string = str ? str : "";
+			} break;
+
+			case MPV_FORMAT_NODE:
+				return FromNode(*static_cast<const mpv_node*>(data));
+
+			default:
+				value.format = MPV_FORMAT_NONE;
+				break;
+		}
+
+		return value;
+	}
+
+	Recorder::~Recorder() {
+		Close();
+	}
+
+	bool Recorder::Open(const std::string& path, const std::vector<std::pair<std::string, Value>>& earlier_reads) {
+		std::lock_guard<std::mutex> guard(lock);
+
+		if(file)
+			return false;
+
+		file = std::fopen(path.c_str(), "wb");
+		if(!file)
+			return false;
+
+		start = Utils::Clock::Now();
+		last_us = 0;
+
+		auto unix_start_us = static_cast<std::int64_t>(Utils::Clock::UnixNow() * 1000000.0);
+
+		std::fwrite(magic, sizeof(magic), 1, file);
+		std::fwrite(&version, sizeof(version), 1, file);
+		std::fwrite(&unix_start_us, sizeof(unix_start_us), 1, file);
+
+		for(auto& read : earlier_reads)
+			WriteProperty(read.first.c_str(), MPV_FORMAT_NODE, &read.second);
+
+		ModernMPV::Properties::property_listener() = this;
+		return true;
+	}
+
+	void Recorder::Close() {
+		// Unhook first, so nobody comes in while we're closing.
+		ModernMPV::Properties::PropertyListener* self = this;
+		ModernMPV::Properties::property_listener().compare_exchange_strong(self, nullptr);
+
+		std::lock_guard<std::mutex> guard(lock);
+		if(!file)
+			return;
+
+		std::fclose(file);
+		file = nullptr;
+	}
+
+	void Recorder::BeginRecord(RecordType type) {
+		auto now = std::chrono::duration_cast<std::chrono::microseconds>(Utils::Clock::Now() - start).count();
+
+		// Reads on other threads can race the clock; never go backwards.
+		if(now < last_us)
+			now = last_us;
+
+		buffer.clear();
+		buffer.push_back(static_cast<std::uint8_t>(type));
+		PutUInt(buffer, static_cast<std::uint64_t>(now - last_us));
+		last_us = now;
+	}
+
+	void Recorder::EndRecord() {
+		std::fwrite(buffer.data(), 1, buffer.size(), file);
+	}
+
+	void Recorder::RecordEvent(const mpv_event* ev) {
+		std::lock_guard<std::mutex> guard(lock);
+		if(!file || !ev)
+			return;
+
+		BeginRecord(RecordType::Event);
+		PutUInt(buffer, ev->event_id);
+		PutInt(buffer, ev->error);
+		PutUInt(buffer, ev->reply_userdata);
+
+		switch(ev->event_id) {
+			case MPV_EVENT_PROPERTY_CHANGE: {
+				auto prop = static_cast<const mpv_event_property*>(ev->data);
+				PutString(buffer, prop->name);
+				PutUInt(buffer, prop->format);
+				PutUInt(buffer, prop->data != nullptr);
+				if(prop->data)
+					PutValue(buffer, Value::FromData(prop->format, prop->data));
+			} break;
+
+			case MPV_EVENT_START_FILE: {
+				auto start_file = static_cast<const mpv_event_start_file*>(ev->data);
+				PutInt(buffer, start_file ? start_file->playlist_entry_id : 0);
+			} break;
+
+			case MPV_EVENT_END_FILE: {
+				auto end_file = static_cast<const mpv_event_end_file*>(ev->data);
+				PutInt(buffer, end_file ? end_file->reason : 0);
+				PutInt(buffer, end_file ? end_file->error : 0);
+			} break;
+
+			default:
+				break;
+		}
+
+		EndRecord();
+	}
+
+	void Recorder::PropertyRead(const char* name, mpv_format format, const void* value) {
+		std::lock_guard<std::mutex> guard(lock);
+		if(!file)
+			return;
+
+		if(value) {
+			auto copy = Value::FromData(format, value);
+			WriteProperty(name, format, &copy);
+		} else {
+			WriteProperty(name, format, nullptr);
+		}
+	}
+
+	void Recorder::WriteProperty(const char* name, mpv_format format, const Value* value) {
+		BeginRecord(RecordType::Property);
+		PutString(buffer, name);
+		PutUInt(buffer, format);
+		PutUInt(buffer, value != nullptr);
+		if(value)
+			PutValue(buffer, *value);
+
+		EndRecord();
+	}
+
+	Reader::~Reader() {
+		if(file)
+			std::fclose(file);
+	}
+
+	bool Reader::Open(const std::string& path) {
+		file = std::fopen(path.c_str(), "rb");
+		if(!file)
+			return false;
+
+		char file_magic[sizeof(magic)];
+		std::uint32_t file_version;
+
+		if(std::fread(file_magic, sizeof(file_magic), 1, file) != 1
+			|| memcmp(file_magic, magic, sizeof(magic)) != 0
+			|| std::fread(&file_version, sizeof(file_version), 1, file) != 1
+			|| file_version != version
+			|| std::fread(&unix_start_us, sizeof(unix_start_us), 1, file) != 1) {
+			corrupt = true;
+			return false;
+		}
+
+		return true;
+	}
+
+	bool Reader::Next(Record& record) {
+		if(!file || corrupt)
+			return false;
+
+		int type = std::fgetc(file);
+		if(type == EOF)
+			return false;
+
+		record = Record();
+		record.type = static_cast<RecordType>(type);
+
+		std::uint64_t delta, u;
+		std::int64_t i;
+
+		if(!GetUInt(file, delta)) {
+			corrupt = true;
+			return false;
+		}
+
+		last_us += static_cast<std::int64_t>(delta);
+		record.time_us = last_us;
+
+		auto read_property = [&]() {
+			if(!GetString(file, record.name) || !GetUInt(file, u))
+				return false;
+			record.format = static_cast<mpv_format>(u);
+
+			if(!GetUInt(file, u))
+				return false;
+			record.available = u != 0;
+
+			return !record.available || GetValue(file, record.value);
+		};
+
+		bool ok = true;
+
+		switch(record.type) {
+			case RecordType::Event: {
+				ok = GetUInt(file, u);
+				record.event_id = static_cast<mpv_event_id>(u);
+				ok = ok && GetInt(file, i);
+				record.error = static_cast<int>(i);
+				ok = ok && GetUInt(file, record.reply_userdata);
+
+				if(!ok)
+					break;
+
+				if(record.event_id == MPV_EVENT_PROPERTY_CHANGE) {
+					ok = read_property();
+				} else if(record.event_id == MPV_EVENT_START_FILE) {
+					ok = GetInt(file, record.playlist_entry_id);
+				} else if(record.event_id == MPV_EVENT_END_FILE) {
+					ok = GetInt(file, i);
+					record.end_reason = static_cast<int>(i);
+					// END_FILE's error is stored after the reason
+					ok = ok && GetInt(file, i);
+					record.error = static_cast<int>(i);
+				}
+			} break;
+
+			case RecordType::Property:
+				ok = read_property();
+				break;
+
+			default:
+				ok = false;
+				break;
+		}
+
+		if(!ok)
+			corrupt = true;
+
+		return ok;
+	}
+
+}
+
+}
@@ -0,0 +1,255 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "SymHide.hpp"
+#include "ModernMPV.hpp"
+#include "Clock.hpp"
+
+#ifdef DOXYGEN
+namespace mdrpc {
+#else
+namespace mdrpc LOCAL_SYM {
+#endif
+
+/**
+ * Recording and reading of mpv event traces.
+ *
+ * A trace is every mpv event the plugin received, plus every property value it read,
+ * in the order they happened. Replaying one (see tools/replay) reproduces the plugin's
+ * behaviour offline, without mpv or Discord.
+ *
+ * The format is a small header (magic, version, Unix start time) followed by records.
+ * Every record starts with its type and the time since the previous record;
+ * integers are LEB128 varints (signed ones zigzag encoded), doubles are stored raw and
+ * strings are length-prefixed. Traces are only meant to be read on the machine
+ * (well, the endianness) they were recorded on.
+ */
+namespace EventTrace {
+
+	/**
+	 * Trace file magic.
+	 */
+	constexpr static char magic[4] = { 'M', 'D', 'E', 'T' };
+
+	/**
+	 * Trace format version.
+	 */
+	constexpr static std::uint32_t version = 1;
+
+	/**
+	 * Type of a record in the trace.
+	 */
+	enum class RecordType : std::uint8_t {
+		Event = 1,
+		Property = 2
+	};
+
+	/**
+	 * Owning copy of a value read from mpv (including whole node trees).
+	 */
+	struct Value {
+		mpv_format format = MPV_FORMAT_NONE;
+
+		/**
+		 * Value for MPV_FORMAT_FLAG and MPV_FORMAT_INT64.
+		 */
+		std::int64_t integer = 0;
+
+		/**
+		 * Value for MPV_FORMAT_DOUBLE.
+		 */
+		double number = 0.0;
+
+		/**
+		 * Value for MPV_FORMAT_STRING and MPV_FORMAT_OSD_STRING.
+		 */
+		std::string string;
+
+		/**
+		 * Keys for MPV_FORMAT_NODE_MAP.
+		 */
+		std::vector<std::string> keys;
+
+		/**
+		 * Values for MPV_FORMAT_NODE_MAP and MPV_FORMAT_NODE_ARRAY.
+		 */
+		std::vector<Value> children;
+
+		/**
+		 * Copies a value as mpv returned it.
+		 *
+		 * \param[in] format Format the value was read in. MPV_FORMAT_NODE values are stored with the node's format.
+		 * \param[in] data Pointer to the value (as passed to mpv_get_property())
+		 */
+		static Value FromData(mpv_format format, const void* data);
+
+		/**
+		 * Copies a node (and everything under it).
+		 *
+		 * \param[in] node Node to copy
+		 */
+		static Value FromNode(const mpv_node& node);
+
+		/**
+		 * Makes a node map of strings, as ModernMPV::Properties::get_string_map() reads them.
+		 *
+		 * \param[in] map Map to copy
+		 */
+		static Value FromStringMap(const std::map<std::string, std::string>& map);
+	};
+
+	/**
+	 * A decoded trace record.
+	 */
+	struct Record {
+		RecordType type = RecordType::Event;
+
+		/**
+		 * Time since the trace was started, in microseconds.
+		 */
+		std::int64_t time_us = 0;
+
+		/**
+		 * \defgroup EventTraceEvent Event records
+		 * @{
+		 */
+		mpv_event_id event_id = MPV_EVENT_NONE;
+		int error = 0;
+		std::uint64_t reply_userdata = 0;
+
+		/**
+		 * Playlist entry ID, for MPV_EVENT_START_FILE.
+		 */
+		std::int64_t playlist_entry_id = 0;
+
+		/**
+		 * End reason, for MPV_EVENT_END_FILE.
+		 */
+		int end_reason = 0;
+		/** @} */
+
+		/**
+		 * \defgroup EventTraceProperty Property records (and MPV_EVENT_PROPERTY_CHANGE)
+		 * @{
+		 */
+		std::string name;
+		mpv_format format = MPV_FORMAT_NONE;
+
+		/**
+		 * False if the read failed (or the property is unavailable).
+		 */
+		bool available = false;
+		Value value;
+		/** @} */
+	};
+
+	/**
+	 * Records a trace. Installed as the ModernMPV property listener while recording.
+	 * Safe to use from several threads.
+	 */
+	struct Recorder : ModernMPV::Properties::PropertyListener {
+
+		~Recorder();
+
+		/**
+		 * Creates the trace file and starts recording property reads.
+		 *
+		 * \param[in] path File to write to (overwritten)
+		 * \param[in] earlier_reads Node properties that were read before recording could start
+		 *                          (e.g. the options telling where to record to), as name and value
+		 * \return False if the file could not be created.
+		 */
+		bool Open(const std::string& path, const std::vector<std::pair<std::string, Value>>& earlier_reads = {});
+
+		/**
+		 * Stops recording and closes the trace file.
+		 */
+		void Close();
+
+		/**
+		 * Records an event received from mpv.
+		 *
+		 * \param[in] ev The event
+		 */
+		void RecordEvent(const mpv_event* ev);
+
+		void PropertyRead(const char* name, mpv_format format, const void* value) override;
+
+	private:
+
+		/**
+		 * Starts a new record in the buffer. The lock must be held.
+		 */
+		void BeginRecord(RecordType type);
+
+		/**
+		 * Writes the buffered record out. The lock must be held.
+		 */
+		void EndRecord();
+
+		/**
+		 * Writes a property record. The lock must be held.
+		 */
+		void WriteProperty(const char* name, mpv_format format, const Value* value);
+
+		std::mutex lock;
+		std::FILE* file = nullptr;
+		Utils::Clock::time_point start;
+		std::int64_t last_us = 0;
+		std::vector<std::uint8_t> buffer;
+	};
+
+	/**
+	 * Reads a trace back.
+	 */
+	struct Reader {
+
+		~Reader();
+
+		/**
+		 * Opens a trace file and reads its header.
+		 *
+		 * \param[in] path File to read
+		 * \return False if the file could not be opened or is not a trace.
+		 */
+		bool Open(const std::string& path);
+
+		/**
+		 * Reads the next record.
+		 *
+		 * \param[out] record Record to read into
+		 * \return False at the end of the trace, or if it is corrupt (see Corrupt()).
+		 */
+		bool Next(Record& record);
+
+		/**
+		 * Returns true if reading stopped because of a malformed record.
+		 */
+		bool Corrupt() const {
+			return corrupt;
+		}
+
+		/**
+		 * Returns the Unix time (in microseconds) the trace was started at.
+		 */
+		std::int64_t UnixStartUs() const {
+			return unix_start_us;
+		}
+
+	private:
+		std::FILE* file = nullptr;
+		std::int64_t unix_start_us = 0;
+		std::int64_t last_us = 0;
+		bool corrupt = false;
+	};
+
+}
+
+}
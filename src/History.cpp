@@ -0,0 +1,387 @@
+#include "History.hpp"
+#include "Tracing.hpp"
+#include "Log.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+
+#ifdef _WIN32
+	#include <io.h>
+#else
+	#include <unistd.h>
+#endif
+
+#ifdef DOXYGEN
+namespace mdrpc {
+#else
+namespace mdrpc LOCAL_SYM {
+#endif
+
+namespace History {
+
+	/**
+	 * Size of the log header.
+	 */
+	constexpr static std::uint64_t header_size = sizeof(magic) + sizeof(version);
+
+	/**
+	 * Number of queued plays that get written right away, without waiting for batch_delay.
+	 */
+	constexpr static std::size_t batch_plays = 32;
+
+	/**
+	 * How long the writer waits for a batch to fill up after the first play was queued.
+	 */
+	constexpr static std::chrono::seconds batch_delay(10);
+
+	/**
+	 * Number of rotated logs kept around (`<path>.1` is the newest).
+	 */
+	constexpr static int rotate_keep = 5;
+
+	/**
+	 * Largest record payload the reader accepts.
+	 */
+	constexpr static std::uint32_t max_record_size = 1u << 26;
+
+	template<class T>
+	static void Put(std::vector<std::uint8_t>& out, T value) {
+		std::uint8_t raw[sizeof(T)];
+		memcpy(raw, &value, sizeof(T));
+		out.insert(out.end(), raw, raw + sizeof(T));
+	}
+
+	static void PutString(std::vector<std::uint8_t>& out, const std::string& str) {
+		Put(out, static_cast<std::uint32_t>(str.size()));
+		out.insert(out.end(), str.begin(), str.end());
+	}
+
+	/**
+	 * Appends a whole record (length and payload) for a play.
+	 */
+	static void PutPlay(std::vector<std::uint8_t>& out, const Play& play) {
+		auto length_at = out.size();
+		Put(out, std::uint32_t(0));
+
+		Put(out, play.start_us);
+		Put(out, play.stop_us);
+		Put(out, play.paused_us);
+		Put(out, play.end_reason);
+		PutString(out, play.path);
+		PutString(out, play.artist);
+		PutString(out, play.title);
+		PutString(out, play.album);
+
+		auto length = static_cast<std::uint32_t>(out.size() - length_at - sizeof(std::uint32_t));
+		memcpy(&out[length_at], &length, sizeof(length));
+	}
+
+	/**
+	 * Reads values back from a record payload, failing (for good) once it runs out.
+	 */
+	struct PayloadReader {
+		const std::uint8_t* data;
+		std::size_t size;
+		bool ok = true;
+
+		template<class T>
+		void Get(T& value) {
+			if(!ok || size < sizeof(T)) {
+				ok = false;
+				return;
+			}
+
+			memcpy(&value, data, sizeof(T));
+			data += sizeof(T);
+			size -= sizeof(T);
+		}
+
+		void GetString(std::string& str) {
+			std::uint32_t length = 0;
+			Get(length);
+
+			if(!ok || size < length) {
+				ok = false;
+				return;
+			}
+
+			str.assign(reinterpret_cast<const char*>(data), length);
+			data += length;
+			size -= length;
+		}
+	};
+
+	/**
+	 * Makes sure what was written to a file reached the disk.
+	 */
+	static void Sync(std::FILE* file) {
+#if defined(_WIN32)
+		_commit(_fileno(file));
+#elif defined(__APPLE__)
+		fsync(fileno(file));
+#else
+		fdatasync(fileno(file));
+#endif
+	}
+
+	std::FILE* Writer::Create(const std::string& path) {
+		auto file = std::fopen(path.c_str(), "wb");
+		if(!file)
+			return nullptr;
+
+		std::fwrite(magic, sizeof(magic), 1, file);
+		std::fwrite(&version, sizeof(version), 1, file);
+
+		if(std::fflush(file) != 0) {
+			std::fclose(file);
+			return nullptr;
+		}
+
+		return file;
+	}
+
+	/**
+	 * Returns how much of an existing log is whole records (skipping over the payloads),
+	 * or 0 if the file is not a history log.
+	 */
+	static std::uint64_t CompleteLength(std::FILE* file) {
+		char file_magic[sizeof(magic)];
+		std::uint32_t file_version;
+
+		if(std::fread(file_magic, sizeof(file_magic), 1, file) != 1
+			|| memcmp(file_magic, magic, sizeof(magic)) != 0
+			|| std::fread(&file_version, sizeof(file_version), 1, file) != 1
+			|| file_version != version)
+			return 0;
+
+		std::fseek(file, 0, SEEK_END);
+		auto size = static_cast<std::uint64_t>(std::ftell(file));
+		auto complete = header_size;
+
+		std::uint32_t length;
+		while(complete + sizeof(length) <= size) {
+			std::fseek(file, static_cast<long>(complete), SEEK_SET);
+
+			if(std::fread(&length, sizeof(length), 1, file) != 1 || complete + sizeof(length) + length > size)
+				break;
+
+			complete += sizeof(length) + length;
+		}
+
+		return complete;
+	}
+
+	bool Writer::Open(const std::string& log_path, std::uint64_t rotate_at) {
+		if(thread.joinable())
+			return false;
+
+		// Append to an existing log, but never to something else.
+		if(auto existing = std::fopen(log_path.c_str(), "rb")) {
+			bool empty = std::fgetc(existing) == EOF;
+			std::rewind(existing);
+
+			auto complete = empty ? 0 : CompleteLength(existing);
+			std::fseek(existing, 0, SEEK_END);
+			auto size = static_cast<std::uint64_t>(std::ftell(existing));
+			std::fclose(existing);
+
+			if(!empty && complete == 0)
+				return false;
+
+			// Drop a record cut off by a crash, so new ones don't end up behind it.
+			if(complete != size) {
+				std::error_code error;
+				std::filesystem::resize_file(log_path, complete, error);
+			}
+
+			if(!empty)
+				file = std::fopen(log_path.c_str(), "ab");
+		}
+
+		if(!file)
+			file = Create(log_path);
+
+		if(!file)
+			return false;
+
+		std::fseek(file, 0, SEEK_END);
+		file_size = static_cast<std::uint64_t>(std::ftell(file));
+		path = log_path;
+		rotate_bytes = rotate_at;
+		stopping = false;
+
+		thread = std::thread([this]() {
+			Run();
+		});
+
+		return true;
+	}
+
+	void Writer::Close() {
+		if(!thread.joinable())
+			return;
+
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			stopping = true;
+		}
+
+		wake.notify_one();
+		thread.join();
+
+		if(file) {
+			std::fclose(file);
+			file = nullptr;
+		}
+	}
+
+	void Writer::Submit(Play play) {
+		{
+			std::lock_guard<std::mutex> guard(lock);
+
+			if(!thread.joinable() || stopping)
+				return;
+
+			pending.push_back(std::move(play));
+		}
+
+		wake.notify_one();
+	}
+
+	void Writer::Run() {
+		std::vector<Play> batch;
+		std::vector<std::uint8_t> records;
+
+		std::unique_lock<std::mutex> guard(lock);
+
+		while(true) {
+			wake.wait(guard, [&]() {
+				return stopping || !pending.empty();
+			});
+
+			// Give the batch a while to fill up, unless we are shutting down.
+			wake.wait_for(guard, batch_delay, [&]() {
+				return stopping || pending.size() >= batch_plays;
+			});
+
+			batch.swap(pending);
+			bool stop = stopping;
+			guard.unlock();
+
+			if(!batch.empty()) {
+				records.clear();
+				for(auto& play : batch)
+					PutPlay(records, play);
+
+				batch.clear();
+				Write(records);
+			}
+
+			if(stop)
+				return;
+
+			guard.lock();
+		}
+	}
+
+	void Writer::Write(const std::vector<std::uint8_t>& records) {
+		MDRPC_TRACE_SPAN("History::Writer::Write");
+
+		if(file && file_size > header_size && file_size + records.size() > rotate_bytes && !Rotate())
+			MDRPC_LOG_ERROR("could not rotate listening history %s, history is no longer written", path.c_str());
+
+		if(!file)
+			return;
+
+		std::fwrite(records.data(), 1, records.size(), file);
+		std::fflush(file);
+		Sync(file);
+		file_size += records.size();
+	}
+
+	bool Writer::Rotate() {
+		std::fclose(file);
+		file = nullptr;
+
+		auto rotated = [&](int n) {
+			return path + '.' + std::to_string(n);
+		};
+
+		// rename() does not replace existing files everywhere, so make room first.
+		std::remove(rotated(rotate_keep).c_str());
+
+		for(int n = rotate_keep - 1; n > 0; --n)
+			std::rename(rotated(n).c_str(), rotated(n + 1).c_str());
+
+		std::rename(path.c_str(), rotated(1).c_str());
+
+		file = Create(path);
+		file_size = header_size;
+		return file != nullptr;
+	}
+
+	Reader::~Reader() {
+		if(file)
+			std::fclose(file);
+	}
+
+	bool Reader::Open(const std::string& path) {
+		file = std::fopen(path.c_str(), "rb");
+		if(!file)
+			return false;
+
+		char file_magic[sizeof(magic)];
+		std::uint32_t file_version;
+
+		if(std::fread(file_magic, sizeof(file_magic), 1, file) != 1
+			|| memcmp(file_magic, magic, sizeof(magic)) != 0
+			|| std::fread(&file_version, sizeof(file_version), 1, file) != 1
+			|| file_version != version) {
+			corrupt = true;
+			return false;
+		}
+
+		return true;
+	}
+
+	bool Reader::Next(Play& play) {
+		if(!file || corrupt)
+			return false;
+
+		// A short read means the writer was cut off mid-record; that is just the end of the log
+		// (the writer drops the partial record before it appends again).
+		std::uint32_t length;
+		if(std::fread(&length, sizeof(length), 1, file) != 1)
+			return false;
+
+		if(length > max_record_size) {
+			corrupt = true;
+			return false;
+		}
+
+		buffer.resize(length);
+		if(length != 0 && std::fread(buffer.data(), 1, length, file) != length)
+			return false;
+
+		play = Play();
+
+		PayloadReader payload { buffer.data(), buffer.size() };
+		payload.Get(play.start_us);
+		payload.Get(play.stop_us);
+		payload.Get(play.paused_us);
+		payload.Get(play.end_reason);
+		payload.GetString(play.path);
+		payload.GetString(play.artist);
+		payload.GetString(play.title);
+		payload.GetString(play.album);
+
+		if(!payload.ok)
+			corrupt = true;
+
+		return payload.ok;
+	}
+
+}
+
+}
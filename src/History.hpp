@@ -0,0 +1,207 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "SymHide.hpp"
+
+#ifdef DOXYGEN
+namespace mdrpc {
+#else
+namespace mdrpc LOCAL_SYM {
+#endif
+
+/**
+ * The listening history: one record per file that was played, for the user's own analytics.
+ *
+ * The log is a small header (magic, version) followed by records, each one a 32-bit
+ * payload length and the payload: start and stop time, time spent paused (all in Unix
+ * microseconds), the end reason and the length-prefixed path, artist, title and album.
+ * It is only ever appended to, so a crash can at most cut off the last record, which
+ * the reader then skips. Like event traces, logs are in the byte order of the machine
+ * that wrote them.
+ */
+namespace History {
+
+	/**
+	 * Log file magic.
+	 */
+	constexpr static char magic[4] = { 'M', 'D', 'P', 'H' };
+
+	/**
+	 * Log format version.
+	 */
+	constexpr static std::uint32_t version = 1;
+
+	/**
+	 * One completed play of a file.
+	 */
+	struct Play {
+		/**
+		 * Unix time (in microseconds) the file was loaded at.
+		 */
+		std::int64_t start_us = 0;
+
+		/**
+		 * Unix time (in microseconds) playback of the file ended at.
+		 */
+		std::int64_t stop_us = 0;
+
+		/**
+		 * Time spent paused in between, in microseconds.
+		 */
+		std::int64_t paused_us = 0;
+
+		/**
+		 * Why playback ended (an mpv_end_file_reason).
+		 */
+		std::int32_t end_reason = 0;
+
+		std::string path;
+		std::string artist;
+		std::string title;
+		std::string album;
+	};
+
+	/**
+	 * Appends plays to a log from a background thread, so whoever submits them never waits on the disk.
+	 *
+	 * Plays are written in batches: once enough of them queued up, or a while after the first one did.
+	 * Every batch is synced to disk, and the log is rotated (to `<path>.1`, `<path>.2`, ...) before
+	 * it grows past the configured size.
+	 */
+	struct Writer {
+
+		Writer() = default;
+		Writer(const Writer&) = delete;
+		Writer& operator=(const Writer&) = delete;
+
+		~Writer() {
+			Close();
+		}
+
+		/**
+		 * Opens (or creates) the log and starts the writer thread.
+		 *
+		 * \param[in] path Log file to append to
+		 * \param[in] rotate_bytes Size the log is rotated at
+		 * \return False if the file could not be opened or is not a history log.
+		 */
+		bool Open(const std::string& path, std::uint64_t rotate_bytes);
+
+		/**
+		 * Writes everything still queued, syncs it and stops the writer thread.
+		 */
+		void Close();
+
+		/**
+		 * Returns true if the log is open.
+		 */
+		bool IsOpen() const {
+			return thread.joinable();
+		}
+
+		/**
+		 * Queues a play for writing. Never touches the disk.
+		 *
+		 * \param[in] play The play
+		 */
+		void Submit(Play play);
+
+	private:
+
+		/**
+		 * Writer thread.
+		 */
+		void Run();
+
+		/**
+		 * Appends encoded records to the log and syncs it, rotating it first if they would not fit.
+		 * Only called by the writer thread.
+		 */
+		void Write(const std::vector<std::uint8_t>& records);
+
+		/**
+		 * Moves the current log out of the way and starts a new one.
+		 * Only called by the writer thread.
+		 *
+		 * \return False if a new log could not be created.
+		 */
+		bool Rotate();
+
+		/**
+		 * Creates a log file with just a header.
+		 */
+		static std::FILE* Create(const std::string& path);
+
+		std::mutex lock;
+		std::condition_variable wake;
+
+		/**
+		 * Plays waiting for the writer thread. Guarded by lock.
+		 */
+		std::vector<Play> pending;
+
+		/**
+		 * Set when the writer thread should write what is left and exit. Guarded by lock.
+		 */
+		bool stopping = false;
+
+		std::thread thread;
+
+		/**
+		 * \defgroup HistoryWriterThread Only touched by the writer thread (while it runs)
+		 * @{
+		 */
+		std::FILE* file = nullptr;
+		std::string path;
+		std::uint64_t file_size = 0;
+		std::uint64_t rotate_bytes = 0;
+		/** @} */
+	};
+
+	/**
+	 * Reads a log back.
+	 */
+	struct Reader {
+
+		~Reader();
+
+		/**
+		 * Opens a log file and reads its header.
+		 *
+		 * \param[in] path File to read
+		 * \return False if the file could not be opened or is not a history log.
+		 */
+		bool Open(const std::string& path);
+
+		/**
+		 * Reads the next play.
+		 *
+		 * \param[out] play Play to read into
+		 * \return False at the end of the log, or if it is corrupt (see Corrupt()).
+		 */
+		bool Next(Play& play);
+
+		/**
+		 * Returns true if reading stopped because of a malformed record.
+		 * A record cut off at the very end (by a crash while writing it) does not count.
+		 */
+		bool Corrupt() const {
+			return corrupt;
+		}
+
+	private:
+		std::FILE* file = nullptr;
+		std::vector<std::uint8_t> buffer;
+		bool corrupt = false;
+	};
+
+}
+
+}
@@ -1,13 +1,23 @@
 #include <thread>
 #include <mutex>
+#include <condition_variable>
 #include <functional>
 #include <chrono>
 #include <memory>
+#include <atomic>
+
+#include "Tracing.hpp"
+
+#ifdef MDRPC_VIRTUAL_CLOCK
+#include "Clock.hpp"
+#endif
 
 //
 // define PIR_NOT_USED_BY_MDRPC to gain access to a Start() overload that can handle calling 
 // the interval function with arguments
 //
+// define MDRPC_VIRTUAL_CLOCK to gain access to ManualIntervalRunner
+//
 
 #ifdef DOXYGEN
 namespace Utils {
@@ -21,12 +31,7 @@ namespace Utils LOCAL_SYM {
     struct IntervalRunner {
 
         ~IntervalRunner() {
-            if(runner_thread.get() != nullptr) {
-                if(runner_thread->joinable())
-                    runner_thread->join();
-                else
-                    runner_thread.reset();
-            }
+            Stop();
         }
 
         /**
@@ -77,13 +82,35 @@ namespace Utils LOCAL_SYM {
 #endif
 
         /**
-         * Stop the current runner.
+         * Stop the current runner, and wait for the runner thread to exit.
+         * The runner can be started again afterwards.
          */ 
         void Stop() {
-            if(!started)
+            if(runner_thread.get() == nullptr)
                 return;
-            
-            stop = true;
+
+            {
+                std::lock_guard<std::mutex> lock(wait_lock);
+                stop = true;
+            }
+            wait_cv.notify_all();
+
+            if(runner_thread->joinable())
+                runner_thread->join();
+
+            runner_thread.reset();
+            stop = false;
+        }
+
+        /**
+         * Cut the current interval short, so the function is called as soon as possible.
+         */
+        void Wake() {
+            {
+                std::lock_guard<std::mutex> lock(wait_lock);
+                wake = true;
+            }
+            wait_cv.notify_all();
         }
 
 		/**
@@ -95,6 +122,20 @@ namespace Utils LOCAL_SYM {
 
     private:
 
+        /**
+         * Sleep for the given interval, or until Stop() or Wake() is called.
+         *
+         * \param[in] interval Interval (in milliseconds) to wait
+         */
+        void Wait(std::uint16_t interval) {
+            MDRPC_TRACE_SPAN("IntervalRunner sleep");
+            std::unique_lock<std::mutex> lock(wait_lock);
+            wait_cv.wait_for(lock, std::chrono::milliseconds(interval), [&]() {
+                return stop || wake;
+            });
+            wake = false;
+        }
+
         /**
          * Generic function for the the thread to run.
          * 
@@ -110,7 +151,7 @@ namespace Utils LOCAL_SYM {
                     break;
 
                 fun();
-                std::this_thread::sleep_for(std::chrono::milliseconds(interval));
+                Wait(interval);
             }
 
             started = false;
@@ -134,7 +175,7 @@ namespace Utils LOCAL_SYM {
                     break;
 
                 fun();
-                std::this_thread::sleep_for(std::chrono::milliseconds(interval));
+                Wait(interval);
             }
 
             started = false;
@@ -156,7 +197,7 @@ namespace Utils LOCAL_SYM {
                     break;
 
                 fun(std::forward<Args...>(args...));
-                std::this_thread::sleep_for(std::chrono::milliseconds(interval));
+                Wait(interval);
             }
 
             started = false;
@@ -168,18 +209,118 @@ namespace Utils LOCAL_SYM {
          */ 
         std::shared_ptr<std::thread> runner_thread;
 
+        /**
+         * Lock protecting the stop/wake flags for the interval wait.
+         */
+        std::mutex wait_lock;
+
+        /**
+         * Signalled to cut an interval wait short.
+         */
+        std::condition_variable wait_cv;
 
         /**
          * Whether or not the runner thread is active.
          */ 
-        bool started = false;
+        std::atomic_bool started { false };
 
         /**
          * Indicates that the runner function should stop and kill the thread,
          * stopping execution of the user's specified function.
          */
-        bool stop = false;
+        std::atomic_bool stop { false };
+
+        /**
+         * Indicates that the current interval wait should end early.
+         */
+        bool wake = false;
     };
 
 
+#ifdef MDRPC_VIRTUAL_CLOCK
+    /**
+     * Drop-in replacement for IntervalRunner that does not start a thread,
+     * and instead runs the function when Poll() is called and the (virtual) interval has passed.
+     * Used to replay event traces deterministically.
+     */
+    struct ManualIntervalRunner {
+
+        /**
+         * Start calling a function on an interval.
+         * 
+         * \param[in] interval Interval to call function
+         * \param[in] fun Function to call on an interval
+         */
+        template<class F>
+        void Start(std::uint16_t interval, F fun) {
+            this->interval = std::chrono::milliseconds(interval);
+            this->fun = fun;
+            next_due = Clock::Now();
+            started = true;
+        }
+
+        /**
+         * Start calling a function on an interval.
+         * The init function is called right away.
+         * 
+         * \param[in] interval Interval to call function
+         * \param[in] fun Function to call on an interval
+         * \param[in] initFun Function to call first
+         */
+        template<class F, class FInit>
+        void Start(std::uint16_t interval, F fun, FInit initFun) {
+            initFun();
+            Start(interval, fun);
+        }
+
+        /**
+         * Stop the current runner.
+         */ 
+        void Stop() {
+            started = false;
+        }
+
+        /**
+         * Make the function due right away.
+         */
+        void Wake() {
+            next_due = Clock::Now();
+        }
+
+        /**
+         * Returns true if this runner is currently started.
+         */
+        bool Running() const {
+            return started;
+        }
+
+        /**
+         * Returns the point in time the function is next due at.
+         */
+        Clock::time_point NextDue() const {
+            return next_due;
+        }
+
+        /**
+         * Calls the function if it is due.
+         *
+         * \return True if the function was called.
+         */
+        bool Poll() {
+            if(!started || Clock::Now() < next_due)
+                return false;
+
+            next_due = Clock::Now() + interval;
+            fun();
+            return true;
+        }
+
+    private:
+        std::function<void()> fun;
+        std::chrono::milliseconds interval { 0 };
+        Clock::time_point next_due;
+        bool started = false;
+    };
+#endif
+
 }
@@ -0,0 +1,276 @@
+#include "Log.hpp"
+
+#include <atomic>
+#include <cstdarg>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#ifdef DOXYGEN
+namespace mdrpc {
+#else
+namespace mdrpc LOCAL_SYM {
+#endif
+
+namespace Log {
+
+	/**
+	 * Messages kept per thread until the mpv thread gets to them.
+	 */
+	constexpr static std::size_t ring_size = 64;
+
+	/**
+	 * Longest message (including the terminator); longer ones are cut.
+	 */
+	constexpr static std::size_t text_size = 240;
+
+	struct Record {
+		/**
+		 * Position among all messages, so rings can be drained in the order they were written.
+		 */
+		std::uint64_t sequence;
+		Level level;
+		char text[text_size];
+	};
+
+	/**
+	 * A single thread's ring. Only the owning thread writes records, only the draining thread reads them.
+	 */
+	struct ThreadRing {
+		std::atomic<std::uint64_t> head { 0 };
+		std::atomic<std::uint64_t> tail { 0 };
+		std::atomic<std::uint32_t> dropped { 0 };
+
+		/**
+		 * Set once the owning thread exited; the ring is freed as soon as it was drained.
+		 */
+		std::atomic<bool> exited { false };
+
+		/**
+		 * Head as of the start of the current Drain(). Only used by the draining thread.
+		 */
+		std::uint64_t drain_head = 0;
+
+		Record records[ring_size];
+	};
+
+	static std::atomic<Level> max_level { Level::Info };
+	static std::atomic<std::uint64_t> next_sequence { 0 };
+
+	/**
+	 * Messages Drain() printed so far; everything is drained when this caught up with next_sequence.
+	 * Only used by the draining thread.
+	 */
+	static std::uint64_t drained_sequence = 0;
+
+	/**
+	 * Set when any ring dropped a message, until Drain() reported it.
+	 */
+	static std::atomic<bool> any_dropped { false };
+
+	static std::atomic<void (*)(void*)> wakeup_function { nullptr };
+	static std::atomic<void*> wakeup_userdata { nullptr };
+
+	/**
+	 * Rings of all threads that logged something. Rings outlive their threads until
+	 * they were drained, so messages from threads that already exited still get printed.
+	 */
+	static std::mutex registry_lock;
+	static std::vector<std::unique_ptr<ThreadRing>> registry;
+
+	/**
+	 * Owns the calling thread's ring, and hands it over to Drain() to free when the thread exits.
+	 */
+	struct ThreadRingOwner {
+		ThreadRing* ring = nullptr;
+
+		~ThreadRingOwner() {
+			if(ring)
+				ring->exited.store(true, std::memory_order_release);
+		}
+	};
+
+	static ThreadRing* GetThreadRing() {
+		thread_local ThreadRingOwner owner;
+
+		// only the first message on a thread takes the lock
+		if(!owner.ring) {
+			std::lock_guard<std::mutex> guard(registry_lock);
+			registry.emplace_back(new ThreadRing());
+			owner.ring = registry.back().get();
+		}
+
+		return owner.ring;
+	}
+
+	void SetLevel(Level level) {
+		max_level = level;
+	}
+
+	/**
+	 * Converts an mpv level name.
+	 */
+	static Level ParseLevel(const std::string& name, Level def) {
+		if(name == "no")
+			return Level::None;
+
+		if(name == "fatal" || name == "error")
+			return Level::Error;
+
+		if(name == "warn")
+			return Level::Warn;
+
+		if(name == "info" || name == "status")
+			return Level::Info;
+
+		if(name == "v")
+			return Level::Verbose;
+
+		if(name == "debug" || name == "trace")
+			return Level::Debug;
+
+		return def;
+	}
+
+	const char* LevelName(Level level) {
+		switch(level) {
+			case Level::Error:
+				return "error";
+
+			case Level::Warn:
+				return "warn";
+
+			case Level::Info:
+				return "info";
+
+			case Level::Verbose:
+				return "v";
+
+			case Level::Debug:
+				return "debug";
+
+			default:
+				return "no";
+		}
+	}
+
+	Level LevelFromMpv(const std::map<std::string, std::string>& msg_levels, const std::string& module) {
+		auto level = Level::Info;
+
+		auto all = msg_levels.find("all");
+		if(all != msg_levels.end())
+			level = ParseLevel(all->second, level);
+
+		auto own = msg_levels.find(module);
+		if(own != msg_levels.end())
+			level = ParseLevel(own->second, level);
+
+		return level;
+	}
+
+	void Write(Level level, const char* format, ...) {
+		if(level == Level::None || level > max_level.load(std::memory_order_relaxed))
+			return;
+
+		auto ring = GetThreadRing();
+		auto head = ring->head.load(std::memory_order_relaxed);
+
+		if(head - ring->tail.load(std::memory_order_acquire) >= ring_size) {
+			ring->dropped.fetch_add(1, std::memory_order_relaxed);
+			any_dropped.store(true, std::memory_order_release);
+			return;
+		}
+
+		auto& record = ring->records[head % ring_size];
+		record.sequence = next_sequence.fetch_add(1, std::memory_order_relaxed);
+		record.level = level;
+
+		va_list args;
+		va_start(args, format);
+		std::vsnprintf(record.text, sizeof(record.text), format, args);
+		va_end(args);
+
+		ring->head.store(head + 1, std::memory_order_release);
+
+		auto wakeup = wakeup_function.load(std::memory_order_acquire);
+		if(wakeup)
+			wakeup(wakeup_userdata.load(std::memory_order_relaxed));
+	}
+
+	void SetWakeup(void (*wakeup)(void* userdata), void* userdata) {
+		wakeup_userdata.store(userdata, std::memory_order_relaxed);
+		wakeup_function.store(wakeup, std::memory_order_release);
+	}
+
+	std::size_t Drain(void (*print)(void* userdata, Level level, const char* text), void* userdata) {
+		// Woken up for nothing (or for messages an earlier call already printed).
+		if(next_sequence.load(std::memory_order_relaxed) == drained_sequence && !any_dropped.load(std::memory_order_acquire))
+			return 0;
+
+		// Threads only take the lock for their first message, so
+		// draining under it hardly ever makes one of them wait.
+		std::lock_guard<std::mutex> guard(registry_lock);
+
+		// Only what was queued when we started, so a busy thread can't keep us here.
+		for(auto& ring : registry)
+			ring->drain_head = ring->head.load(std::memory_order_acquire);
+
+		std::size_t printed = 0;
+
+		// Merge the rings by sequence; there are only ever a handful of them.
+		while(true) {
+			ThreadRing* oldest = nullptr;
+			const Record* oldest_record = nullptr;
+
+			for(auto& ring : registry) {
+				auto tail = ring->tail.load(std::memory_order_relaxed);
+
+				if(tail == ring->drain_head)
+					continue;
+
+				auto& record = ring->records[tail % ring_size];
+
+				if(!oldest_record || record.sequence < oldest_record->sequence) {
+					oldest = ring.get();
+					oldest_record = &record;
+				}
+			}
+
+			if(!oldest)
+				break;
+
+			print(userdata, oldest_record->level, oldest_record->text);
+			oldest->tail.fetch_add(1, std::memory_order_release);
+			++printed;
+		}
+
+		drained_sequence += printed;
+
+		if(any_dropped.exchange(false, std::memory_order_acquire)) {
+			for(auto& ring : registry) {
+				auto dropped = ring->dropped.exchange(0, std::memory_order_relaxed);
+
+				if(dropped != 0) {
+					char text[64];
+					std::snprintf(text, sizeof(text), "%u log messages dropped", dropped);
+					print(userdata, Level::Warn, text);
+				}
+			}
+		}
+
+		// Free the rings of threads that are gone, once nothing is left in them.
+		for(auto it = registry.begin(); it != registry.end();) {
+			auto& ring = **it;
+
+			if(ring.exited.load(std::memory_order_acquire) && ring.tail.load(std::memory_order_relaxed) == ring.head.load(std::memory_order_relaxed))
+				it = registry.erase(it);
+			else
+				++it;
+		}
+
+		return printed;
+	}
+}
+
+}
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+
+#include "SymHide.hpp"
+
+//
+// Log levels, the same as mpv's. MDRPC_LOG_LEVEL is the most verbose level compiled in
+// (configure with -DMDRPC_LOG_LEVEL=<error|warn|info|v|debug>); the MDRPC_LOG_*() macros
+// for anything more verbose expand to nothing, arguments and all.
+//
+
+#define MDRPC_LOG_LEVEL_ERROR 1
+#define MDRPC_LOG_LEVEL_WARN 2
+#define MDRPC_LOG_LEVEL_INFO 3
+#define MDRPC_LOG_LEVEL_VERBOSE 4
+#define MDRPC_LOG_LEVEL_DEBUG 5
+
+#ifndef MDRPC_LOG_LEVEL
+	#define MDRPC_LOG_LEVEL MDRPC_LOG_LEVEL_VERBOSE
+#endif
+
+#if MDRPC_LOG_LEVEL >= MDRPC_LOG_LEVEL_ERROR
+	#define MDRPC_LOG_ERROR(...) ::mdrpc::Log::Write(::mdrpc::Log::Level::Error, __VA_ARGS__)
+#else
+	#define MDRPC_LOG_ERROR(...) (void)0
+#endif
+
+#if MDRPC_LOG_LEVEL >= MDRPC_LOG_LEVEL_WARN
+	#define MDRPC_LOG_WARN(...) ::mdrpc::Log::Write(::mdrpc::Log::Level::Warn, __VA_ARGS__)
+#else
+	#define MDRPC_LOG_WARN(...) (void)0
+#endif
+
+#if MDRPC_LOG_LEVEL >= MDRPC_LOG_LEVEL_INFO
+	#define MDRPC_LOG_INFO(...) ::mdrpc::Log::Write(::mdrpc::Log::Level::Info, __VA_ARGS__)
+#else
+	#define MDRPC_LOG_INFO(...) (void)0
+#endif
+
+#if MDRPC_LOG_LEVEL >= MDRPC_LOG_LEVEL_VERBOSE
+	#define MDRPC_LOG_VERBOSE(...) ::mdrpc::Log::Write(::mdrpc::Log::Level::Verbose, __VA_ARGS__)
+#else
+	#define MDRPC_LOG_VERBOSE(...) (void)0
+#endif
+
+#if MDRPC_LOG_LEVEL >= MDRPC_LOG_LEVEL_DEBUG
+	#define MDRPC_LOG_DEBUG(...) ::mdrpc::Log::Write(::mdrpc::Log::Level::Debug, __VA_ARGS__)
+#else
+	#define MDRPC_LOG_DEBUG(...) (void)0
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+	#define MDRPC_LOG_PRINTF(format_index, args_index) __attribute__((format(printf, format_index, args_index)))
+#else
+	#define MDRPC_LOG_PRINTF(format_index, args_index)
+#endif
+
+#ifdef DOXYGEN
+namespace mdrpc {
+#else
+namespace mdrpc LOCAL_SYM {
+#endif
+
+/**
+ * Log messages, from any thread, printed by the mpv thread.
+ *
+ * Every thread formats its messages into fixed-size records in its own ring
+ * (a single-producer, single-consumer ring), so logging never takes a lock or
+ * waits on output. When a ring is full, messages are dropped and counted instead.
+ * The mpv thread drains all rings in the order messages were written and prints
+ * them through mpv, so they honor `--msg-level` and end up in `--log-file`.
+ */
+namespace Log {
+
+	enum class Level : std::uint8_t {
+		/**
+		 * Nothing is logged. Only meaningful for SetLevel().
+		 */
+		None = 0,
+		Error = MDRPC_LOG_LEVEL_ERROR,
+		Warn = MDRPC_LOG_LEVEL_WARN,
+		Info = MDRPC_LOG_LEVEL_INFO,
+		Verbose = MDRPC_LOG_LEVEL_VERBOSE,
+		Debug = MDRPC_LOG_LEVEL_DEBUG
+	};
+
+	/**
+	 * Sets the most verbose level that is logged at runtime. Defaults to Level::Info, like mpv.
+	 */
+	void SetLevel(Level level);
+
+	/**
+	 * Returns the level a module is logged at, according to mpv's `msg-level` option.
+	 *
+	 * \param[in] msg_levels Value of the `msg-level` option (module to level name)
+	 * \param[in] module Module name to look up; `all` applies if it has no entry of its own
+	 * \return The level, or Level::Info if neither is set.
+	 */
+	Level LevelFromMpv(const std::map<std::string, std::string>& msg_levels, const std::string& module);
+
+	/**
+	 * Returns mpv's name for a level (`error`, `warn`, `info`, `v` or `debug`).
+	 */
+	const char* LevelName(Level level);
+
+	/**
+	 * Formats and queues a message on the calling thread's ring.
+	 * Use the MDRPC_LOG_*() macros instead of calling this directly.
+	 *
+	 * \param[in] level Message level
+	 * \param[in] format printf() style format
+	 */
+	void Write(Level level, const char* format, ...) MDRPC_LOG_PRINTF(2, 3);
+
+	/**
+	 * Sets a function that is called (on the logging thread) after every queued message,
+	 * to wake up whoever drains the rings. Pass nullptr to stop.
+	 *
+	 * \param[in] wakeup Function to call
+	 * \param[in] userdata Passed to wakeup
+	 */
+	void SetWakeup(void (*wakeup)(void* userdata), void* userdata);
+
+	/**
+	 * Hands every queued message to print, oldest first. Only ever call this from one thread.
+	 * Returns right away if nothing was queued (or dropped) since the last call.
+	 *
+	 * \param[in] print Called with each message's level and text
+	 * \param[in] userdata Passed to print
+	 * \return The number of messages printed.
+	 */
+	std::size_t Drain(void (*print)(void* userdata, Level level, const char* text), void* userdata);
+
+}
+
+}
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <atomic>
 #include <cstdint>
 #include <cstring>
 #include <iostream>
@@ -53,13 +54,50 @@ namespace ModernMPV {
 
 	namespace Properties {
 
+		/**
+		 * Interface for observing every property read done through ModernMPV::Properties,
+		 * e.g. to record them.
+		 */
+		struct PropertyListener {
+			virtual ~PropertyListener() = default;
+
+			/**
+			 * Called after a property read.
+			 *
+			 * \param[in] name Name of the property
+			 * \param[in] format Format the property was read in (MPV_FORMAT_OSD_STRING for OSD strings)
+			 * \param[in] value Pointer to the value as mpv returned it, or nullptr if the read failed
+			 */
+			virtual void PropertyRead(const char* name, mpv_format format, const void* value) = 0;
+		};
+
+		/**
+		 * The currently installed property listener, or nullptr for none.
+		 */
+		inline std::atomic<PropertyListener*>& property_listener() {
+			static std::atomic<PropertyListener*> listener { nullptr };
+			return listener;
+		}
+
+		/**
+		 * Tell the installed listener (if any) about a property read.
+		 */
+		inline void notify_property_read(const std::string& property_name, mpv_format format, const void* value) {
+			auto listener = property_listener().load(std::memory_order_acquire);
+			if(listener)
+				listener->PropertyRead(property_name.c_str(), format, value);
+		}
+
 	/**
 	 * Macro to generate parts of the function body
 	 * that do not change for the following functions.
 	 */
 	#define MDN_GENERATE_GET_BODY(T, PropertyT) T value; \
-			if(mpv_get_property(handle, property_name.c_str(), PropertyT, &value) < 0) \
-			return;	\
+			if(mpv_get_property(handle, property_name.c_str(), PropertyT, &value) < 0) { \
+				notify_property_read(property_name, PropertyT, nullptr); \
+				return;	\
+			} \
+			notify_property_read(property_name, PropertyT, &value);
 
 		/**
 		 * Get an bool/flag property.
@@ -130,6 +168,7 @@ namespace ModernMPV {
 		template<class Functor>
 		inline void get_osd_string_raw(SafeHandle& handle, const std::string& property_name, Functor callback) {
 			char* value = mpv_get_property_osd_string(handle, property_name.c_str());
+			notify_property_read(property_name, MPV_FORMAT_OSD_STRING, value ? &value : nullptr);
 			if(!value)
 				return;
 	
@@ -210,7 +249,7 @@ namespace ModernMPV {
 
 			get_string_raw(handle, property_name, [&](char* returned) {
 				auto len = strlen(returned);
-				str.resize(len);
+				str.reserve(len);
 
 				for(int i = 0; i < len; ++i)
 					if(returned[i] != '\0')
@@ -231,7 +270,7 @@ namespace ModernMPV {
 
 			get_osd_string_raw(handle, property_name, [&](char* returned) {
 				auto len = strlen(returned);
-				str.resize(len);
+				str.reserve(len);
 				for(int i = 0; i < len; ++i)
 					if(returned[i] != '\0')
 						str.push_back(returned[i]);
@@ -251,7 +290,7 @@ namespace ModernMPV {
 				return str; 
 
 			auto size = strlen(node.u.string);
-			str.resize(size);
+			str.reserve(size);
 
 			for(int i = 0; i < size; ++i)
 				if(node.u.string[i] != '\0')
@@ -260,6 +299,31 @@ namespace ModernMPV {
 			return str;
 		}
 
+		/**
+		 * Look up a string value in a existing map node without copying it.
+		 * The returned pointer is only valid for as long as the node is.
+		 *
+		 * \param[in] node Map node to search
+		 * \param[in] key Key to look for
+		 * \return The string, or nullptr if the key is missing or not a string.
+		 */
+		inline const char* find_node_map_string(const mpv_node& node, const char* key) {
+			if(node.format != MPV_FORMAT_NODE_MAP)
+				return nullptr;
+
+			for(int i = 0; i < node.u.list->num; ++i) {
+				if(strcmp(node.u.list->keys[i], key) != 0)
+					continue;
+
+				if(node.u.list->values[i].format != MPV_FORMAT_STRING)
+					return nullptr;
+
+				return node.u.list->values[i].u.string;
+			}
+
+			return nullptr;
+		}
+
 		/**
 		 * Get an node map property converted to a C++ map.
 		 * 
@@ -284,6 +348,29 @@ namespace ModernMPV {
 			return values;
 		}
 
+		/**
+		 * Get an node map property converted to a C++ map of strings.
+		 * Unlike get_node_map(), the values are copied out of the node before it is freed,
+		 * so they stay valid. Entries that are not strings are skipped.
+		 *
+		 * \param[in] handle Safe handle to use
+		 * \param[in] property_name Name of property to fetch
+		 */
+		inline std::map<std::string, std::string> get_string_map(SafeHandle& handle, const std::string& property_name) {
+			std::map<std::string, std::string> values;
+
+			get_node_map_raw(handle, property_name, [&](mpv_node node) {
+					for(int i = 0; i < node.u.list->num; ++i) {
+						if(node.u.list->values[i].format != MPV_FORMAT_STRING)
+							continue;
+
+						values[node.u.list->keys[i]] = get_node_string(node.u.list->values[i]);
+					}
+			});
+
+			return values;
+		}
+
 		/**
 		 * Get an node array property converted to a C++ vector.
 		 * 
@@ -0,0 +1,72 @@
+#include "Options.hpp"
+#include "Log.hpp"
+
+#include <cstdlib>
+
+#ifdef DOXYGEN
+namespace mdrpc {
+#else
+namespace mdrpc LOCAL_SYM {
+#endif
+
+	/**
+	 * Prefix all of our script-opts keys share.
+	 */
+	constexpr static char option_prefix[] = "mdrpc-";
+
+	void Options::Load(ModernMPV::SafeHandle& handle) {
+		script_opts = ModernMPV::Properties::get_string_map(handle, "script-opts");
+		auto& opts = script_opts;
+
+		settle_ms = GetUInt(opts, "settle-ms", settle_ms);
+		record_path = GetString(opts, "record", record_path);
+		trace_path = GetString(opts, "trace", trace_path);
+		asset_index_path = GetString(opts, "asset-index", asset_index_path);
+		history_path = GetString(opts, "history", history_path);
+		history_rotate_kb = GetUInt(opts, "history-rotate-kb", history_rotate_kb);
+		discord_register = GetFlag(opts, "register", discord_register);
+	}
+
+	std::uint32_t Options::GetUInt(const std::map<std::string, std::string>& opts, const char* key, std::uint32_t def) {
+		auto it = opts.find(std::string(option_prefix) + key);
+
+		if(it == opts.end() || it->second.empty())
+			return def;
+
+		char* end = nullptr;
+		auto value = std::strtoul(it->second.c_str(), &end, 10);
+
+		if(*end != '\0') {
+			MDRPC_LOG_WARN("ignoring invalid value \"%s\" for %s", it->second.c_str(), it->first.c_str());
+			return def;
+		}
+
+		return static_cast<std::uint32_t>(value);
+	}
+
+	bool Options::GetFlag(const std::map<std::string, std::string>& opts, const char* key, bool def) {
+		auto it = opts.find(std::string(option_prefix) + key);
+
+		if(it == opts.end() || it->second.empty())
+			return def;
+
+		if(it->second == "yes" || it->second == "true" || it->second == "1")
+			return true;
+
+		if(it->second == "no" || it->second == "false" || it->second == "0")
+			return false;
+
+		MDRPC_LOG_WARN("ignoring invalid value \"%s\" for %s", it->second.c_str(), it->first.c_str());
+		return def;
+	}
+
+	std::string Options::GetString(const std::map<std::string, std::string>& opts, const char* key, const std::string& def) {
+		auto it = opts.find(std::string(option_prefix) + key);
+
+		if(it == opts.end())
+			return def;
+
+		return it->second;
+	}
+
+}
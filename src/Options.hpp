@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <map>
+
+#include "SymHide.hpp"
+#include "ModernMPV.hpp"
+
+#ifdef DOXYGEN
+namespace mdrpc {
+#else
+namespace mdrpc LOCAL_SYM {
+#endif
+
+	/**
+	 * User-configurable options.
+	 *
+	 * These are read from mpv's `script-opts` option, with every key prefixed by `mdrpc-`,
+	 * e.g. `--script-opts=mdrpc-settle-ms=500`.
+	 */
+	struct Options {
+
+		/**
+		 * How long (in milliseconds) the player has to stay on one file
+		 * (without seeking) before metadata is fetched and presence is published.
+		 */
+		std::uint32_t settle_ms = 250;
+
+		/**
+		 * If set, every mpv event and property read is recorded to this file,
+		 * for replaying offline with the `mdrpc-replay` tool.
+		 */
+		std::string record_path;
+
+		/**
+		 * If set (and mdrpc was built with MDRPC_ENABLE_TRACING), trace spans are recorded
+		 * and written to this file as Chrome trace-event JSON when mpv exits.
+		 */
+		std::string trace_path;
+
+		/**
+		 * If set, an artist/album to Discord asset key index (built with the `mdrpc-asset-index` tool)
+		 * to pick the large image from.
+		 */
+		std::string asset_index_path;
+
+		/**
+		 * If set, a record of every file that was played is appended to this file,
+		 * for reading with the `mdrpc-history` tool.
+		 */
+		std::string history_path;
+
+		/**
+		 * Size (in KiB) the listening history is rotated at.
+		 */
+		std::uint32_t history_rotate_kb = 4096;
+
+		/**
+		 * Whether to register mdrpc's Discord application with the system
+		 * (on Linux, a desktop file and a `discord-<appid>://` mime handler) when Discord is initialized.
+		 */
+		bool discord_register = true;
+
+		/**
+		 * All of `script-opts` as Load() read it (not just ours), so an event trace can have it.
+		 */
+		std::map<std::string, std::string> script_opts;
+
+		/**
+		 * Loads options from mpv, keeping the defaults for anything not specified.
+		 *
+		 * \param[in] handle Safe handle to use
+		 */
+		void Load(ModernMPV::SafeHandle& handle);
+
+	private:
+
+		/**
+		 * Gets a unsigned integer option.
+		 *
+		 * \param[in] opts Options map to use
+		 * \param[in] key Option name, without the `mdrpc-` prefix
+		 * \param[in] def Value to return if the option is missing or invalid
+		 */
+		static std::uint32_t GetUInt(const std::map<std::string, std::string>& opts, const char* key, std::uint32_t def);
+
+		/**
+		 * Gets a yes/no option.
+		 *
+		 * \param[in] opts Options map to use
+		 * \param[in] key Option name, without the `mdrpc-` prefix
+		 * \param[in] def Value to return if the option is missing or invalid
+		 */
+		static bool GetFlag(const std::map<std::string, std::string>& opts, const char* key, bool def);
+
+		/**
+		 * Gets a string option.
+		 *
+		 * \param[in] opts Options map to use
+		 * \param[in] key Option name, without the `mdrpc-` prefix
+		 * \param[in] def Value to return if the option is missing
+		 */
+		static std::string GetString(const std::map<std::string, std::string>& opts, const char* key, const std::string& def);
+	};
+
+}
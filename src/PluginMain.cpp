@@ -1,6 +1,9 @@
 #include "SymHide.hpp"
 #include "DiscordPlugin.hpp"
 #include "Singleton.hpp"
+#include "EventTrace.hpp"
+#include "Tracing.hpp"
+#include "Log.hpp"
 #include "Version.hpp"
 
 #ifdef _WIN32
@@ -15,12 +18,39 @@ extern "C" {
 	EXPORT_SYM int mpv_open_cplugin(mpv_handle* handle) {
 		Utils::Singleton<mdrpc::DiscordPlugin> plugin_singleton;
 
-		auto plugin = plugin_singleton.Get(handle);
+		auto& plugin = plugin_singleton.Get(handle);
+
+		MDRPC_LOG_INFO("version %s!!", mdrpc::Version::tag);
+
+		mdrpc::EventTrace::Recorder recorder;
+		if(!plugin.GetOptions().record_path.empty()) {
+			// The plugin read these when it was created, before it knew where to record to.
+			std::vector<std::pair<std::string, mdrpc::EventTrace::Value>> earlier_reads = {
+				{ "msg-level", mdrpc::EventTrace::Value::FromStringMap(plugin.GetMsgLevels()) },
+				{ "script-opts", mdrpc::EventTrace::Value::FromStringMap(plugin.GetOptions().script_opts) }
+			};
+
+			if(recorder.Open(plugin.GetOptions().record_path, earlier_reads)) {
+				MDRPC_LOG_INFO("recording event trace to %s", plugin.GetOptions().record_path.c_str());
+			} else {
+				MDRPC_LOG_ERROR("could not open %s for recording", plugin.GetOptions().record_path.c_str());
+			}
+		}
+
+		if(!plugin.GetOptions().trace_path.empty()) {
+#ifdef MDRPC_TRACING
+			mdrpc::Tracing::Enable();
+#else
+			MDRPC_LOG_WARN("built without MDRPC_ENABLE_TRACING, ignoring mdrpc-trace");
+#endif
+		}
 
-		std::cout << "mdrpc version " << mdrpc::Version::tag << "!!\n";
 		while(true) {
 			auto handle = plugin.mpvHandle.get();
-			mpv_event* event = mpv_wait_event(handle, -1);
+			mpv_event* event = mpv_wait_event(handle, plugin.WaitTimeout());
+
+			if(event->event_id != MPV_EVENT_NONE)
+				recorder.RecordEvent(event);
 
 			if(event->event_id == MPV_EVENT_SHUTDOWN) {
 				// allow processing shutdown events so we can (cleanly)
@@ -29,8 +59,19 @@ extern "C" {
 				break;
 			}
 			plugin.ProcessEvent(event);
+			plugin.Update();
 		}
 
+		recorder.Close();
+
+#ifdef MDRPC_TRACING
+		// The runners and the Discord IO thread are stopped by now.
+		if(mdrpc::Tracing::Enabled() && !mdrpc::Tracing::Dump(plugin.GetOptions().trace_path))
+			MDRPC_LOG_ERROR("could not write trace to %s", plugin.GetOptions().trace_path.c_str());
+#endif
+
+		plugin.FlushLog();
+
 		// plugin EOL
 		return 0;
 	}
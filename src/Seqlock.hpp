@@ -0,0 +1,92 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#include "SymHide.hpp"
+
+#ifdef DOXYGEN
+namespace Utils {
+#else
+namespace Utils LOCAL_SYM {
+#endif
+
+	/**
+	 * Publishes a value from a single writer thread to any number of readers, without locks.
+	 *
+	 * The writer bumps a sequence number to odd, stores the value and bumps it back to even.
+	 * Readers copy the value and retry if the sequence number was odd or changed meanwhile,
+	 * so they always get a consistent copy and never block the writer.
+	 *
+	 * The value is kept as atomic words (rather than raw bytes), so concurrent reads and writes
+	 * are not data races.
+	 *
+	 * \tparam T Value type. Must be trivially copyable.
+	 */
+	template<class T>
+	struct Seqlock {
+		static_assert(std::is_trivially_copyable<T>::value, "Seqlock values must be trivially copyable");
+
+		Seqlock() {
+			Store(T());
+		}
+
+		/**
+		 * Publishes a new value. Only ever call this from one thread.
+		 *
+		 * \param[in] value Value to publish
+		 */
+		void Store(const T& value) {
+			std::uint64_t buffer[word_count] {};
+			memcpy(buffer, &value, sizeof(T));
+
+			auto seq = sequence.load(std::memory_order_relaxed);
+			sequence.store(seq + 1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release);
+
+			for(std::size_t i = 0; i < word_count; ++i)
+				words[i].store(buffer[i], std::memory_order_relaxed);
+
+			sequence.store(seq + 2, std::memory_order_release);
+		}
+
+		/**
+		 * Returns a consistent copy of the last published value. Safe from any thread.
+		 */
+		T Load() const {
+			std::uint64_t buffer[word_count];
+			std::uint64_t before;
+			std::uint64_t after;
+
+			do {
+				before = sequence.load(std::memory_order_acquire);
+
+				for(std::size_t i = 0; i < word_count; ++i)
+					buffer[i] = words[i].load(std::memory_order_relaxed);
+
+				std::atomic_thread_fence(std::memory_order_acquire);
+				after = sequence.load(std::memory_order_relaxed);
+			} while(before != after || (before & 1));
+
+			T value;
+			memcpy(&value, buffer, sizeof(T));
+			return value;
+		}
+
+		/**
+		 * Returns how many times a value was published. Changes whenever the value might have.
+		 */
+		std::uint64_t Version() const {
+			return sequence.load(std::memory_order_acquire) / 2;
+		}
+
+	private:
+		constexpr static std::size_t word_count = (sizeof(T) + sizeof(std::uint64_t) - 1) / sizeof(std::uint64_t);
+
+		std::atomic<std::uint64_t> sequence { 0 };
+		std::atomic<std::uint64_t> words[word_count];
+	};
+
+}
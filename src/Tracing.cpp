@@ -0,0 +1,145 @@
+#include "Tracing.hpp"
+
+#ifdef MDRPC_TRACING
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <discord_rpc.h>
+
+#ifdef DOXYGEN
+namespace mdrpc {
+#else
+namespace mdrpc LOCAL_SYM {
+#endif
+
+namespace Tracing {
+
+	/**
+	 * Spans kept per thread. Older spans are overwritten once a thread records more.
+	 */
+	constexpr static std::size_t ring_size = 16384;
+
+	struct Event {
+		const char* name;
+		std::uint64_t start_ns;
+		std::uint64_t end_ns;
+	};
+
+	/**
+	 * A single thread's ring. Only the owning thread writes to it.
+	 */
+	struct ThreadRing {
+		std::uint32_t tid = 0;
+		std::atomic<std::uint64_t> head { 0 };
+		Event events[ring_size];
+	};
+
+	static std::atomic_bool enabled { false };
+
+	/**
+	 * All rings ever created. Rings outlive their threads, so spans from
+	 * runner threads that already exited still get dumped.
+	 */
+	static std::mutex registry_lock;
+	static std::vector<std::unique_ptr<ThreadRing>> registry;
+
+	static ThreadRing* GetThreadRing() {
+		thread_local ThreadRing* ring = nullptr;
+
+		if(!ring) {
+			std::lock_guard<std::mutex> guard(registry_lock);
+			registry.emplace_back(new ThreadRing());
+			ring = registry.back().get();
+			ring->tid = static_cast<std::uint32_t>(registry.size());
+		}
+
+		return ring;
+	}
+
+	std::uint64_t NowNs() {
+		return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count());
+	}
+
+	bool Enabled() {
+		return enabled.load(std::memory_order_relaxed);
+	}
+
+	void Enable() {
+		enabled = true;
+#ifdef DISCORD_ENABLE_TRACE_HOOKS
+		Discord_SetTraceSpanHook(&Record);
+#endif
+	}
+
+	void Record(const char* name, std::uint64_t start_ns, std::uint64_t end_ns) {
+		auto ring = GetThreadRing();
+		auto head = ring->head.load(std::memory_order_relaxed);
+
+		ring->events[head % ring_size] = { name, start_ns, end_ns };
+		ring->head.store(head + 1, std::memory_order_release);
+	}
+
+	/**
+	 * Writes a string with JSON escaping.
+	 */
+	static void WriteJsonString(std::FILE* file, const char* str) {
+		std::fputc('"', file);
+
+		for(; *str; ++str) {
+			auto c = static_cast<unsigned char>(*str);
+
+			if(c == '"' || c == '\\')
+				std::fprintf(file, "\\%c", c);
+			else if(c < 0x20)
+				std::fprintf(file, "\\u%04x", c);
+			else
+				std::fputc(c, file);
+		}
+
+		std::fputc('"', file);
+	}
+
+	bool Dump(const std::string& path) {
+		std::FILE* file = std::fopen(path.c_str(), "w");
+		if(!file)
+			return false;
+
+		std::lock_guard<std::mutex> guard(registry_lock);
+		bool first = true;
+
+		std::fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", file);
+
+		for(auto& ring : registry) {
+			auto head = ring->head.load(std::memory_order_acquire);
+			auto begin = head > ring_size ? head - ring_size : 0;
+
+			for(auto i = begin; i < head; ++i) {
+				auto& event = ring->events[i % ring_size];
+
+				std::fputs(first ? "\n" : ",\n", file);
+				first = false;
+
+				std::fputs("{\"name\":", file);
+				WriteJsonString(file, event.name);
+				std::fprintf(file, ",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+					ring->tid,
+					static_cast<double>(event.start_ns) / 1000.0,
+					static_cast<double>(event.end_ns - event.start_ns) / 1000.0);
+			}
+		}
+
+		std::fputs("\n]}\n", file);
+		return std::fclose(file) == 0;
+	}
+
+}
+
+}
+
+#endif
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "SymHide.hpp"
+
+//
+// Trace spans are only compiled in when MDRPC_TRACING is defined
+// (configure with -DMDRPC_ENABLE_TRACING=ON). Otherwise MDRPC_TRACE_SPAN() expands to nothing.
+//
+
+#ifdef MDRPC_TRACING
+	#define MDRPC_TRACE_CONCAT_(a, b) a##b
+	#define MDRPC_TRACE_CONCAT(a, b) MDRPC_TRACE_CONCAT_(a, b)
+
+	/**
+	 * Records a span covering the rest of the enclosing scope.
+	 * `name` must be a string literal (or otherwise live forever).
+	 */
+	#define MDRPC_TRACE_SPAN(name) ::mdrpc::Tracing::Span MDRPC_TRACE_CONCAT(mdrpc_trace_span_, __LINE__)(name)
+#else
+	#define MDRPC_TRACE_SPAN(name) (void)0
+#endif
+
+#ifdef MDRPC_TRACING
+
+#ifdef DOXYGEN
+namespace mdrpc {
+#else
+namespace mdrpc LOCAL_SYM {
+#endif
+
+/**
+ * Lightweight trace spans.
+ *
+ * Every thread records finished spans into its own fixed-size ring buffer
+ * (a single-producer ring; the newest events win when it wraps), so recording
+ * never takes a lock. The rings are dumped as Chrome trace-event JSON,
+ * which can be loaded in chrome://tracing or Perfetto.
+ */
+namespace Tracing {
+
+	/**
+	 * Returns the current time on the trace clock, in nanoseconds.
+	 */
+	std::uint64_t NowNs();
+
+	/**
+	 * Returns true if recording was turned on with Enable().
+	 */
+	bool Enabled();
+
+	/**
+	 * Turns recording on, including the span hook in discord-rpc.
+	 */
+	void Enable();
+
+	/**
+	 * Records a finished span on the calling thread.
+	 *
+	 * \param[in] name Span name; must live forever
+	 * \param[in] start_ns Start time (from NowNs())
+	 * \param[in] end_ns End time (from NowNs())
+	 */
+	void Record(const char* name, std::uint64_t start_ns, std::uint64_t end_ns);
+
+	/**
+	 * Writes every recorded span as Chrome trace-event JSON.
+	 * Threads should have stopped recording by the time this is called.
+	 *
+	 * \param[in] path File to write
+	 * \return False if the file could not be written.
+	 */
+	bool Dump(const std::string& path);
+
+	/**
+	 * Scoped span. Use MDRPC_TRACE_SPAN() instead of using this directly.
+	 */
+	struct Span {
+		explicit Span(const char* name)
+			: name(name), start_ns(Enabled() ? NowNs() : 0) {
+		}
+
+		~Span() {
+			if(start_ns)
+				Record(name, start_ns, NowNs());
+		}
+
+		Span(const Span&) = delete;
+		Span& operator=(const Span&) = delete;
+
+	private:
+		const char* name;
+		std::uint64_t start_ns;
+	};
+
+}
+
+}
+
+#endif
@@ -0,0 +1,282 @@
+// mdrpc-asset-index: compiles an artist/album -> Discord asset key mapping
+// into the index file mdrpc memory maps (`--script-opts=mdrpc-asset-index=<file>`).
+//
+// Input is one mapping per line, tab separated (or comma separated, with optional
+// double quoting, for .csv files or with --csv):
+//
+//   artist <TAB> album <TAB> asset key     album art
+//   artist <TAB> asset key                 for every album of the artist without its own entry
+//
+// Empty lines and lines starting with '#' are skipped. Later lines win over earlier ones.
+
+#include "AssetIndex.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+	#include <io.h>
+#else
+	#include <unistd.h>
+#endif
+
+namespace Format = mdrpc::AssetIndexFormat;
+
+/**
+ * Splits a line into fields.
+ */
+static std::vector<std::string> SplitLine(const std::string& line, bool csv) {
+	std::vector<std::string> fields(1);
+
+	if(!csv) {
+		for(char c : line) {
+			if(c == '\t')
+				fields.emplace_back();
+			else
+				fields.back().push_back(c);
+		}
+
+		return fields;
+	}
+
+	bool quoted = false;
+
+	for(std::size_t i = 0; i < line.size(); ++i) {
+		char c = line[i];
+
+		if(quoted) {
+			if(c == '"' && i + 1 < line.size() && line[i + 1] == '"') {
+				fields.back().push_back('"');
+				++i;
+			} else if(c == '"') {
+				quoted = false;
+			} else {
+				fields.back().push_back(c);
+			}
+		} else if(c == '"') {
+			quoted = true;
+		} else if(c == ',') {
+			fields.emplace_back();
+		} else {
+			fields.back().push_back(c);
+		}
+	}
+
+	return fields;
+}
+
+/**
+ * Builds the (folded) key for an artist and album, as the plugin looks them up.
+ */
+static std::string MakeKey(const std::string& artist, const std::string& album) {
+	std::string key;
+	key.reserve(artist.size() + 1 + album.size());
+
+	for(char c : artist)
+		key.push_back(Format::Fold(c));
+
+	key.push_back(Format::key_separator);
+
+	for(char c : album)
+		key.push_back(Format::Fold(c));
+
+	return key;
+}
+
+/**
+ * Writes the whole index to a file and makes sure it reached the disk.
+ */
+static bool WriteIndex(const std::string& path, const Format::Header& header, const std::vector<Format::Slot>& slots, const std::string& strings) {
+	auto file = std::fopen(path.c_str(), "wb");
+	if(!file)
+		return false;
+
+	bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1
+		&& std::fwrite(slots.data(), sizeof(Format::Slot), slots.size(), file) == slots.size()
+		&& std::fwrite(strings.data(), 1, strings.size(), file) == strings.size()
+		&& std::fflush(file) == 0;
+
+#if defined(_WIN32)
+	ok = ok && _commit(_fileno(file)) == 0;
+#else
+	ok = ok && fsync(fileno(file)) == 0;
+#endif
+
+	return std::fclose(file) == 0 && ok;
+}
+
+static void Usage(const char* argv0) {
+	std::cerr << "usage: " << argv0 << " [--csv] <mapping.tsv|mapping.csv> <output index>\n";
+}
+
+int main(int argc, char** argv) {
+	const char* input_path = nullptr;
+	const char* output_path = nullptr;
+	bool csv = false;
+
+	for(int i = 1; i < argc; ++i) {
+		if(!strcmp(argv[i], "--csv")) {
+			csv = true;
+		} else if(argv[i][0] != '-' && !input_path) {
+			input_path = argv[i];
+		} else if(argv[i][0] != '-' && !output_path) {
+			output_path = argv[i];
+		} else {
+			Usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if(!input_path || !output_path) {
+		Usage(argv[0]);
+		return 1;
+	}
+
+	auto input_length = strlen(input_path);
+	if(input_length > 4 && !strcmp(input_path + input_length - 4, ".csv"))
+		csv = true;
+
+	std::ifstream input(input_path, std::ios::binary);
+	if(!input) {
+		std::cerr << input_path << ": cannot open\n";
+		return 1;
+	}
+
+	// key -> entry index, so later lines replace earlier ones in place
+	std::unordered_map<std::string, std::size_t> seen;
+	std::vector<std::pair<std::string, std::string>> entries;
+	std::size_t line_number = 0;
+	std::size_t skipped = 0;
+	std::size_t replaced = 0;
+	std::string line;
+
+	while(std::getline(input, line)) {
+		++line_number;
+
+		if(!line.empty() && line.back() == '\r')
+			line.pop_back();
+
+		if(line.empty() || line[0] == '#')
+			continue;
+
+		auto fields = SplitLine(line, csv);
+
+		std::string artist, album, asset;
+
+		if(fields.size() == 2) {
+			artist = fields[0];
+			asset = fields[1];
+		} else if(fields.size() == 3) {
+			artist = fields[0];
+			album = fields[1];
+			asset = fields[2];
+		}
+
+		auto key = MakeKey(artist, album);
+
+		if(artist.empty() || asset.empty() || key.size() > Format::max_string_length || asset.size() > Format::max_string_length) {
+			std::cerr << input_path << ':' << line_number << ": skipped, expected artist[, album], asset key\n";
+			++skipped;
+			continue;
+		}
+
+		auto it = seen.find(key);
+		if(it != seen.end()) {
+			entries[it->second].second = asset;
+			++replaced;
+			continue;
+		}
+
+		seen.emplace(key, entries.size());
+		entries.emplace_back(std::move(key), std::move(asset));
+	}
+
+	// at most 70% full, so probe sequences stay short
+	std::uint32_t slot_count = 1;
+	while(static_cast<std::uint64_t>(slot_count) * 7 < static_cast<std::uint64_t>(entries.size()) * 10 + 7) {
+		if(slot_count >= (1u << 30)) {
+			std::cerr << input_path << ": too many entries\n";
+			return 1;
+		}
+
+		slot_count <<= 1;
+	}
+
+	std::vector<Format::Slot> slots(slot_count);
+	memset(slots.data(), 0, slots.size() * sizeof(Format::Slot));
+
+	std::string strings;
+	std::size_t longest_probe = 0;
+
+	for(auto& entry : entries) {
+		auto separator = entry.first.find(Format::key_separator);
+		auto hash = Format::Hash(entry.first.substr(0, separator), entry.first.substr(separator + 1));
+
+		if(strings.size() + entry.first.size() + entry.second.size() > 0xFFFFFFFFull) {
+			std::cerr << input_path << ": mapping too large\n";
+			return 1;
+		}
+
+		Format::Slot slot;
+		slot.tag = static_cast<std::uint32_t>(hash >> 32);
+		slot.key_offset = static_cast<std::uint32_t>(strings.size());
+		slot.key_length = static_cast<std::uint16_t>(entry.first.size());
+		strings += entry.first;
+		slot.value_offset = static_cast<std::uint32_t>(strings.size());
+		slot.value_length = static_cast<std::uint16_t>(entry.second.size());
+		strings += entry.second;
+
+		std::size_t probe = 0;
+		auto i = static_cast<std::uint32_t>(hash) & (slot_count - 1);
+
+		while(slots[i].key_length != 0) {
+			i = (i + 1) & (slot_count - 1);
+			++probe;
+		}
+
+		slots[i] = slot;
+
+		if(probe > longest_probe)
+			longest_probe = probe;
+	}
+
+	Format::Header header;
+	memcpy(header.magic, Format::magic, sizeof(header.magic));
+	header.version = Format::version;
+	header.slot_count = slot_count;
+	header.entry_count = static_cast<std::uint32_t>(entries.size());
+	header.strings_size = strings.size();
+
+	// A running mpv may have the old index mapped; overwriting it in place could hand it a
+	// half-written table (or SIGBUS). Renaming a complete file over it leaves the old one
+	// to whoever still has it open.
+	auto temp_path = std::string(output_path) + ".tmp";
+
+	if(!WriteIndex(temp_path, header, slots, strings)) {
+		std::cerr << temp_path << ": write failed\n";
+		std::remove(temp_path.c_str());
+		return 1;
+	}
+
+	std::error_code error;
+	std::filesystem::rename(temp_path, output_path, error);
+
+	if(error) {
+		std::cerr << output_path << ": " << error.message() << '\n';
+		std::remove(temp_path.c_str());
+		return 1;
+	}
+
+	std::cout << "entries:       " << entries.size() << " (" << replaced << " replaced, " << skipped << " skipped)\n"
+		<< "slots:         " << slot_count << '\n'
+		<< "longest probe: " << longest_probe << '\n'
+		<< "index size:    " << sizeof(header) + slots.size() * sizeof(Format::Slot) + strings.size() << " bytes\n";
+
+	return 0;
+}
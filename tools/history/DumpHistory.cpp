@@ -0,0 +1,110 @@
+// mdrpc-history: dumps the listening history mdrpc writes (`--script-opts=mdrpc-history=<file>`)
+// as tab separated lines:
+//
+//   start (UTC)   played (s)   paused (s)   end reason   artist   title   album   path
+//
+// Pass rotated logs oldest first (`history.log.2 history.log.1 history.log`) to get everything in order.
+
+#include "History.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <string>
+
+/**
+ * mpv_end_file_reason names, by value.
+ */
+static const char* ReasonName(std::int32_t reason) {
+	static const char* const names[] = { "eof", "unknown", "stop", "quit", "error", "redirect" };
+
+	if(reason < 0 || reason >= static_cast<std::int32_t>(sizeof(names) / sizeof(names[0])))
+		return "unknown";
+
+	return names[reason];
+}
+
+static std::string FormatTime(std::int64_t unix_us) {
+	auto seconds = static_cast<std::time_t>(unix_us / 1000000);
+	char buffer[32];
+
+	std::tm tm {};
+#ifdef _WIN32
+	gmtime_s(&tm, &seconds);
+#else
+	gmtime_r(&seconds, &tm);
+#endif
+
+	std::strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%SZ", &tm);
+	return buffer;
+}
+
+/**
+ * Tabs and newlines would break the columns.
+ */
+static std::string Field(std::string value) {
+	for(auto& c : value)
+		if(c == '\t' || c == '\n' || c == '\r')
+			c = ' ';
+
+	return value;
+}
+
+static void Usage(const char* argv0) {
+	std::cerr << "usage: " << argv0 << " [--no-header] <history log>...\n";
+}
+
+int main(int argc, char** argv) {
+	bool header = true;
+	int first = 1;
+
+	if(argc > 1 && !strcmp(argv[1], "--no-header")) {
+		header = false;
+		++first;
+	}
+
+	if(first >= argc) {
+		Usage(argv[0]);
+		return 1;
+	}
+
+	if(header)
+		std::cout << "start\tplayed\tpaused\treason\tartist\ttitle\talbum\tpath\n";
+
+	int status = 0;
+
+	for(int i = first; i < argc; ++i) {
+		mdrpc::History::Reader reader;
+
+		if(!reader.Open(argv[i])) {
+			std::cerr << argv[i] << ": not a listening history\n";
+			status = 1;
+			continue;
+		}
+
+		mdrpc::History::Play play;
+
+		while(reader.Next(play)) {
+			char played[32], paused[32];
+			std::snprintf(played, sizeof(played), "%.1f", (play.stop_us - play.start_us - play.paused_us) / 1000000.0);
+			std::snprintf(paused, sizeof(paused), "%.1f", play.paused_us / 1000000.0);
+
+			std::cout << FormatTime(play.start_us) << '\t'
+				<< played << '\t'
+				<< paused << '\t'
+				<< ReasonName(play.end_reason) << '\t'
+				<< Field(play.artist) << '\t'
+				<< Field(play.title) << '\t'
+				<< Field(play.album) << '\t'
+				<< Field(play.path) << '\n';
+		}
+
+		if(reader.Corrupt()) {
+			std::cerr << argv[i] << ": corrupt record, stopped reading\n";
+			status = 1;
+		}
+	}
+
+	return status;
+}
@@ -0,0 +1,329 @@
+// mdrpc-replay: replays a recorded event trace through DiscordPlugin,
+// on a virtual clock, and reports what it cost.
+//
+// Record a trace with `--script-opts=mdrpc-record=<file>`.
+
+#include "Stubs.hpp"
+#include "DiscordPlugin.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <new>
+#include <utility>
+
+//
+// allocation counting
+//
+
+static std::atomic<std::uint64_t> allocations { 0 };
+static std::atomic<std::uint64_t> allocated_bytes { 0 };
+
+void* operator new(std::size_t size) {
+	++allocations;
+	allocated_bytes += size;
+
+	if(auto ptr = std::malloc(size ? size : 1))
+		return ptr;
+
+	throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+	return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept {
+	std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+	std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+	std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t) noexcept {
+	std::free(ptr);
+}
+
+namespace Replay LOCAL_SYM {
+
+	/**
+	 * Drives a DiscordPlugin from a trace.
+	 */
+	struct Driver {
+
+		Driver(mdrpc::EventTrace::Reader& reader)
+			: reader(reader) {
+		}
+
+		/**
+		 * Replays the whole trace, then keeps the clock running for tail_ms.
+		 */
+		void Run(std::int64_t tail_ms) {
+			mdrpc::EventTrace::Record record;
+			bool have_record = reader.Next(record);
+
+			SetTime(0);
+
+			// Options and such are read when the plugin is created, before any events.
+			while(have_record && record.type == mdrpc::EventTrace::RecordType::Property) {
+				Apply(record);
+				have_record = reader.Next(record);
+			}
+
+			// SafeHandle wants something non-null; the stubs never look at it.
+			static int fake_handle;
+			mdrpc::DiscordPlugin plugin(reinterpret_cast<mpv_handle*>(&fake_handle));
+			this->plugin = &plugin;
+
+			mdrpc::EventTrace::Record event;
+
+			while(have_record && !shutdown) {
+				// Events recorded at the same moment came in one burst; mpv hands those over
+				// before the runner thread gets a chance to run whatever they woke it up for.
+				AdvanceTo(record.time_us, false);
+				std::swap(event, record);
+
+				// The recorder writes an event before the property reads handling it caused,
+				// so put those in place before the plugin gets to see the event. Reads made by
+				// deferred work before the next event see them too; when a property was read
+				// more than once in between, the last value wins.
+				have_record = reader.Next(record);
+				while(have_record && record.type == mdrpc::EventTrace::RecordType::Property) {
+					Apply(record);
+					have_record = reader.Next(record);
+				}
+
+				Apply(event);
+			}
+
+			if(!shutdown)
+				AdvanceTo(now_us + tail_ms * 1000);
+
+			this->plugin = nullptr;
+		}
+
+		std::uint64_t records = 0;
+		std::uint64_t events = 0;
+
+		/**
+		 * Virtual time of the first FILE_LOADED, or -1.
+		 */
+		std::int64_t first_load_us = -1;
+		bool shutdown = false;
+
+	private:
+
+		void SetTime(std::int64_t us) {
+			now_us = us;
+			Utils::Clock::SetVirtual(us, reader.UnixStartUs());
+		}
+
+		/**
+		 * Runs everything the plugin has due between now and the given time.
+		 *
+		 * \param[in] us Time to advance to
+		 * \param[in] inclusive Also run what is due exactly at that time
+		 */
+		void AdvanceTo(std::int64_t us, bool inclusive = true) {
+			while(true) {
+				auto due = plugin->NextDue();
+				if(due == Utils::Clock::time_point::max())
+					break;
+
+				auto due_us = std::chrono::duration_cast<std::chrono::microseconds>(due.time_since_epoch()).count();
+				if(due_us > us || (!inclusive && due_us == us))
+					break;
+
+				if(due_us > now_us)
+					SetTime(due_us);
+
+				plugin->RunDue();
+
+				// Nothing got rescheduled into the future; don't spin.
+				if(plugin->NextDue() <= due)
+					break;
+			}
+
+			if(us > now_us)
+				SetTime(us);
+		}
+
+		void Apply(const mdrpc::EventTrace::Record& record) {
+			++records;
+
+			if(record.type == mdrpc::EventTrace::RecordType::Property) {
+				SetProperty(record.name, record.format, record.available, record.value);
+				return;
+			}
+
+			++events;
+
+			if(record.event_id == MPV_EVENT_FILE_LOADED && first_load_us < 0)
+				first_load_us = now_us;
+
+			mpv_event ev {};
+			ev.event_id = record.event_id;
+			ev.error = record.error;
+			ev.reply_userdata = record.reply_userdata;
+
+			mpv_event_property prop {};
+			mpv_event_start_file start_file {};
+			mpv_event_end_file end_file {};
+
+			// storage for property change data
+			mpv_node node {};
+			int flag = 0;
+			std::int64_t int64 = 0;
+			double number = 0.0;
+			char* string = nullptr;
+
+			switch(record.event_id) {
+				case MPV_EVENT_PROPERTY_CHANGE:
+					prop.name = record.name.c_str();
+					prop.format = record.available ? record.format : MPV_FORMAT_NONE;
+
+					if(record.available) {
+						switch(record.format) {
+							case MPV_FORMAT_NODE:
+								ToNode(record.value, node);
+								prop.data = &node;
+								break;
+
+							case MPV_FORMAT_FLAG:
+								flag = static_cast<int>(record.value.integer);
+								prop.data = &flag;
+								break;
+
+							case MPV_FORMAT_INT64:
+								int64 = record.value.integer;
+								prop.data = &int64;
+								break;
+
+							case MPV_FORMAT_DOUBLE:
+								number = record.value.number;
+								prop.data = &number;
+								break;
+
+							case MPV_FORMAT_STRING:
+							case MPV_FORMAT_OSD_STRING:
+								string = const_cast<char*>(record.value.string.c_str());
+								prop.data = &string;
+								break;
+
+							default:
+								prop.format = MPV_FORMAT_NONE;
+								break;
+						}
+					}
+
+					ev.data = &prop;
+					break;
+
+				case MPV_EVENT_START_FILE:
+					start_file.playlist_entry_id = record.playlist_entry_id;
+					ev.data = &start_file;
+					break;
+
+				case MPV_EVENT_END_FILE:
+					end_file.reason = record.end_reason;
+					end_file.error = record.error;
+					ev.data = &end_file;
+					break;
+
+				default:
+					break;
+			}
+
+			plugin->ProcessEvent(&ev);
+			plugin->Update();
+
+			if(node.format != MPV_FORMAT_NONE)
+				mpv_free_node_contents(&node);
+
+			if(record.event_id == MPV_EVENT_SHUTDOWN) {
+				// as mpv_open_cplugin() does once the event loop ended
+				plugin->FlushLog();
+				shutdown = true;
+			}
+		}
+
+		mdrpc::EventTrace::Reader& reader;
+		mdrpc::DiscordPlugin* plugin = nullptr;
+	};
+
+}
+
+static void Usage(const char* argv0) {
+	std::cerr << "usage: " << argv0 << " [-v] [--tail <ms>] <trace file>\n"
+		<< "  -v           print every presence update\n"
+		<< "  --tail <ms>  keep the virtual clock running for this long after the last record\n";
+}
+
+int main(int argc, char** argv) {
+	const char* path = nullptr;
+	std::int64_t tail_ms = 0;
+
+	for(int i = 1; i < argc; ++i) {
+		if(!strcmp(argv[i], "-v")) {
+			Replay::verbose = true;
+		} else if(!strcmp(argv[i], "--tail") && i + 1 < argc) {
+			tail_ms = std::strtoll(argv[++i], nullptr, 10);
+		} else if(argv[i][0] != '-' && !path) {
+			path = argv[i];
+		} else {
+			Usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if(!path) {
+		Usage(argv[0]);
+		return 1;
+	}
+
+	mdrpc::EventTrace::Reader reader;
+	if(!reader.Open(path)) {
+		std::cerr << path << ": not a mdrpc event trace (or wrong version)\n";
+		return 1;
+	}
+
+	Replay::Driver driver(reader);
+
+	auto wall_start = std::chrono::steady_clock::now();
+	auto cpu_start = std::clock();
+	auto allocations_start = allocations.load();
+	auto bytes_start = allocated_bytes.load();
+
+	driver.Run(tail_ms);
+
+	auto cpu_ms = static_cast<double>(std::clock() - cpu_start) * 1000.0 / CLOCKS_PER_SEC;
+	auto wall_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - wall_start).count();
+
+	if(reader.Corrupt())
+		std::cerr << path << ": trace is corrupt, stopped early\n";
+
+	auto& discord = Replay::Discord();
+
+	std::cout << "records:          " << driver.records << " (" << driver.events << " events)\n"
+		<< "virtual time:     " << Replay::now_us / 1000000.0 << " s\n"
+		<< "wall time:        " << wall_ms << " ms\n"
+		<< "cpu time:         " << cpu_ms << " ms\n"
+		<< "allocations:      " << allocations.load() - allocations_start
+			<< " (" << allocated_bytes.load() - bytes_start << " bytes)\n"
+		<< "presence updates: " << discord.presence_updates << '\n'
+		<< "presence clears:  " << discord.presence_clears << '\n'
+		<< "discord inits:    " << discord.initializes << '\n';
+
+	if(driver.first_load_us >= 0 && discord.first_presence_us >= driver.first_load_us)
+		std::cout << "first presence:   " << (discord.first_presence_us - driver.first_load_us) / 1000.0 << " ms after the first file loaded\n";
+
+	return reader.Corrupt() ? 2 : 0;
+}
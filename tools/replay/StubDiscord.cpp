@@ -0,0 +1,84 @@
+// Stub discord-rpc that counts what the plugin would have sent.
+
+#include "Stubs.hpp"
+
+#include <discord_rpc.h>
+
+#include <iostream>
+
+namespace Replay LOCAL_SYM {
+
+	bool verbose = false;
+	std::int64_t now_us = 0;
+
+	DiscordStats& Discord() {
+		static DiscordStats stats;
+		return stats;
+	}
+
+}
+
+extern "C" {
+
+	void Discord_Initialize(const char*, DiscordEventHandlers*, int, const char*) {
+		++Replay::Discord().initializes;
+
+		if(Replay::Discord().initialize_us < 0)
+			Replay::Discord().initialize_us = Replay::now_us;
+	}
+
+	void Discord_Shutdown(void) {
+	}
+
+	void Discord_RunCallbacks(void) {
+		++Replay::Discord().run_callbacks;
+	}
+
+	void Discord_UpdatePresence(const DiscordRichPresence* presence) {
+		if(!presence) {
+			++Replay::Discord().presence_clears;
+			return;
+		}
+
+		++Replay::Discord().presence_updates;
+
+		// presence goes out the moment it is queued here; there is no connection to wait for
+		if(Replay::Discord().first_presence_us < 0)
+			Replay::Discord().first_presence_us = Replay::now_us;
+
+		if(Replay::verbose) {
+			std::cout << '[' << Replay::now_us / 1000 << " ms] presence: \""
+				<< (presence->details ? presence->details : "") << "\" / \""
+				<< (presence->state ? presence->state : "") << "\" ("
+				<< presence->startTimestamp << " - " << presence->endTimestamp << ")\n";
+		}
+	}
+
+	void Discord_ClearPresence(void) {
+		Discord_UpdatePresence(nullptr);
+	}
+
+	void Discord_Respond(const char*, int) {
+	}
+
+	void Discord_UpdateHandlers(DiscordEventHandlers*) {
+	}
+
+	void Discord_SetEventNotify(void (*)(void*), void*) {
+	}
+
+	int Discord_GetTimeToFirstPresence(void) {
+		auto& stats = Replay::Discord();
+
+		if(stats.initialize_us < 0 || stats.first_presence_us < 0)
+			return -1;
+
+		return static_cast<int>((stats.first_presence_us - stats.initialize_us) / 1000);
+	}
+
+#ifdef DISCORD_ENABLE_TRACE_HOOKS
+	void Discord_SetTraceSpanHook(DiscordTraceSpanHook) {
+	}
+#endif
+
+}
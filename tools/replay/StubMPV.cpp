@@ -0,0 +1,185 @@
+// Just enough of libmpv's client API for DiscordPlugin, served from the trace being replayed.
+
+#include "Stubs.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <utility>
+
+namespace Replay LOCAL_SYM {
+
+	struct PropertyValue {
+		bool available = false;
+		mdrpc::EventTrace::Value value;
+	};
+
+	static std::map<std::pair<std::string, mpv_format>, PropertyValue>& Properties() {
+		static std::map<std::pair<std::string, mpv_format>, PropertyValue> properties;
+		return properties;
+	}
+
+	void SetProperty(const std::string& name, mpv_format format, bool available, const mdrpc::EventTrace::Value& value) {
+		auto& property = Properties()[std::make_pair(name, format)];
+		property.available = available;
+		property.value = value;
+	}
+
+	static char* CopyString(const std::string& str) {
+		auto copy = static_cast<char*>(std::malloc(str.size() + 1));
+		memcpy(copy, str.c_str(), str.size() + 1);
+		return copy;
+	}
+
+	void ToNode(const mdrpc::EventTrace::Value& value, mpv_node& node) {
+		memset(&node, 0, sizeof(node));
+		node.format = value.format;
+
+		switch(value.format) {
+			case MPV_FORMAT_FLAG:
+				node.u.flag = static_cast<int>(value.integer);
+				break;
+
+			case MPV_FORMAT_INT64:
+				node.u.int64 = value.integer;
+				break;
+
+			case MPV_FORMAT_DOUBLE:
+				node.u.double_ = value.number;
+				break;
+
+			case MPV_FORMAT_STRING:
+			case MPV_FORMAT_OSD_STRING:
+				node.format = MPV_FORMAT_STRING;
+				node.u.string = CopyString(value.string);
+				break;
+
+			case MPV_FORMAT_NODE_MAP:
+			case MPV_FORMAT_NODE_ARRAY: {
+				auto count = static_cast<int>(value.children.size());
+				auto list = static_cast<mpv_node_list*>(std::calloc(1, sizeof(mpv_node_list)));
+
+				list->num = count;
+				list->values = static_cast<mpv_node*>(std::calloc(count ? count : 1, sizeof(mpv_node)));
+
+				if(value.format == MPV_FORMAT_NODE_MAP)
+					list->keys = static_cast<char**>(std::calloc(count ? count : 1, sizeof(char*)));
+
+				for(int i = 0; i < count; ++i) {
+					if(list->keys)
+						list->keys[i] = CopyString(value.keys[i]);
+					ToNode(value.children[i], list->values[i]);
+				}
+
+				node.u.list = list;
+			} break;
+
+			default:
+				node.format = MPV_FORMAT_NONE;
+				break;
+		}
+	}
+
+}
+
+extern "C" {
+
+	void mpv_free(void* data) {
+		std::free(data);
+	}
+
+	void mpv_free_node_contents(mpv_node* node) {
+		switch(node->format) {
+			case MPV_FORMAT_STRING:
+				std::free(node->u.string);
+				break;
+
+			case MPV_FORMAT_NODE_MAP:
+			case MPV_FORMAT_NODE_ARRAY:
+				for(int i = 0; i < node->u.list->num; ++i) {
+					if(node->u.list->keys)
+						std::free(node->u.list->keys[i]);
+					mpv_free_node_contents(&node->u.list->values[i]);
+				}
+				std::free(node->u.list->keys);
+				std::free(node->u.list->values);
+				std::free(node->u.list);
+				break;
+
+			default:
+				break;
+		}
+
+		node->format = MPV_FORMAT_NONE;
+	}
+
+	int mpv_get_property(mpv_handle*, const char* name, mpv_format format, void* data) {
+		auto it = Replay::Properties().find(std::make_pair(std::string(name), format));
+
+		// MPV_ERROR_PROPERTY_UNAVAILABLE
+		if(it == Replay::Properties().end() || !it->second.available)
+			return -10;
+
+		auto& value = it->second.value;
+
+		switch(format) {
+			case MPV_FORMAT_FLAG:
+				*static_cast<int*>(data) = static_cast<int>(value.integer);
+				break;
+
+			case MPV_FORMAT_INT64:
+				*static_cast<std::int64_t*>(data) = value.integer;
+				break;
+
+			case MPV_FORMAT_DOUBLE:
+				*static_cast<double*>(data) = value.number;
+				break;
+
+			case MPV_FORMAT_STRING:
+				*static_cast<char**>(data) = Replay::CopyString(value.string);
+				break;
+
+			case MPV_FORMAT_NODE:
+				Replay::ToNode(value, *static_cast<mpv_node*>(data));
+				break;
+
+			default:
+				// MPV_ERROR_PROPERTY_FORMAT
+				return -9;
+		}
+
+		return 0;
+	}
+
+	char* mpv_get_property_osd_string(mpv_handle*, const char* name) {
+		auto it = Replay::Properties().find(std::make_pair(std::string(name), MPV_FORMAT_OSD_STRING));
+
+		if(it == Replay::Properties().end() || !it->second.available)
+			return nullptr;
+
+		return Replay::CopyString(it->second.value.string);
+	}
+
+	void mpv_wakeup(mpv_handle*) {
+		// the replay loop never blocks
+	}
+
+	int mpv_observe_property(mpv_handle*, uint64_t, const char*, mpv_format) {
+		// changes come from the trace
+		return 0;
+	}
+
+	const char* mpv_client_name(mpv_handle*) {
+		return "mdrpc";
+	}
+
+	int mpv_command(mpv_handle*, const char** args) {
+		// only ever print-text, for log messages
+		if(Replay::verbose && args[0] && args[1] && !strcmp(args[0], "print-text"))
+			std::cout << '[' << Replay::now_us / 1000 << " ms] " << args[1] << '\n';
+
+		return 0;
+	}
+
+}
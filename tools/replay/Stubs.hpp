@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "EventTrace.hpp"
+
+/**
+ * Stub mpv and Discord implementations used by mdrpc-replay.
+ */
+namespace Replay LOCAL_SYM {
+
+	/**
+	 * Sets what the stub mpv_get_property() returns for a property read in a given format,
+	 * until the next time it is set.
+	 *
+	 * \param[in] name Property name
+	 * \param[in] format Format the property is read in (MPV_FORMAT_OSD_STRING for OSD strings)
+	 * \param[in] available False if reads should fail
+	 * \param[in] value Value to return
+	 */
+	void SetProperty(const std::string& name, mpv_format format, bool available, const mdrpc::EventTrace::Value& value);
+
+	/**
+	 * Builds a heap-allocated node tree from a value.
+	 * Free it with mpv_free_node_contents().
+	 *
+	 * \param[in] value Value to convert
+	 * \param[out] node Node to fill in
+	 */
+	void ToNode(const mdrpc::EventTrace::Value& value, mpv_node& node);
+
+	/**
+	 * What the plugin sent to the stub Discord library.
+	 */
+	struct DiscordStats {
+		std::uint64_t initializes = 0;
+		std::uint64_t presence_updates = 0;
+		std::uint64_t presence_clears = 0;
+		std::uint64_t run_callbacks = 0;
+
+		/**
+		 * Virtual time of the first Discord_Initialize() and the first presence update, or -1.
+		 */
+		std::int64_t initialize_us = -1;
+		std::int64_t first_presence_us = -1;
+	};
+
+	/**
+	 * Returns the stub Discord library's counters.
+	 */
+	DiscordStats& Discord();
+
+	/**
+	 * If set, every presence update is printed as it happens.
+	 */
+	extern bool verbose;
+
+	/**
+	 * Current virtual time, for printing.
+	 */
+	extern std::int64_t now_us;
+
+}